@@ -0,0 +1,108 @@
+#include "AudioOutput.h"
+
+#include <algorithm>
+
+AudioOutput::~AudioOutput() {
+    Stop();
+}
+
+void AudioOutput::Start() {
+    if (running) {
+        return;
+    }
+    running = true;
+    thread = std::thread(&AudioOutput::Run, this);
+}
+
+void AudioOutput::Stop() {
+    running = false;
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void AudioOutput::Push(const int16_t* samples, size_t frames) {
+    static_assert(sizeof(StereoFrame) == 2 * sizeof(int16_t), "StereoFrame must match the SPU output layout");
+    ring.Push((const StereoFrame*)samples, frames);
+}
+
+void AudioOutput::SetSink(std::unique_ptr<AudioSink> new_sink) {
+    std::lock_guard<std::mutex> lock(sink_mutex);
+    sink = std::move(new_sink);
+}
+
+void AudioOutput::Run() {
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    uint64_t frames_produced = 0;
+    while (running) {
+        std::this_thread::sleep_for(kTickInterval);
+        auto now = clock::now();
+        uint64_t frames_due = std::chrono::duration_cast<std::chrono::microseconds>(now - start).count()
+            * kSampleRate / 1000000;
+        // Don't try to make up for a long stall (debugger, suspended process) all at once
+        if (frames_due - frames_produced > kMaxStallFrames) {
+            start = now;
+            frames_produced = frames_due = 0;
+            continue;
+        }
+        Produce((size_t)(frames_due - frames_produced));
+        frames_produced = frames_due;
+    }
+}
+
+void AudioOutput::Produce(size_t count) {
+    // Running far ahead (fast-forward), skip to the target latency
+    size_t fill = ring.Size();
+    if (fill > kMaxFill) {
+        input.resize(fill - kTargetFill);
+        ring.Pop(input.data(), input.size());
+        input.clear();
+        input_pos = 0;
+        average_fill = kTargetFill;
+    }
+
+    // Pull everything this tick will need in one go, keeping what rounding left over last time
+    double ratio = GetRateRatio();
+    input.erase(input.begin(), input.begin() + input_pos);
+    input_pos = 0;
+    size_t needed = (size_t)(phase + count * ratio);
+    if (input.size() < needed) {
+        size_t available = input.size();
+        input.resize(needed);
+        input.resize(available + ring.Pop(input.data() + available, needed - available));
+    }
+
+    // Linear interpolation between the last two input frames
+    resampled.resize(count);
+    for (StereoFrame& frame : resampled) {
+        frame.left = (int16_t)(previous.left + (next.left - previous.left) * phase);
+        frame.right = (int16_t)(previous.right + (next.right - previous.right) * phase);
+        phase += ratio;
+        while (phase >= 1.0) {
+            phase -= 1.0;
+            previous = next;
+            next = NextInputFrame();
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(sink_mutex);
+    if (sink) {
+        sink->Write(resampled.data(), resampled.size());
+    }
+}
+
+// Input frames consumed per output frame, above 1 when the ring is filling up
+double AudioOutput::GetRateRatio() {
+    average_fill += ((double)ring.Size() - average_fill) * kFillSmoothing;
+    double error = (average_fill - kTargetFill) / kTargetFill;
+    return 1.0 + std::clamp(error * kMaxRateAdjust, -kMaxRateAdjust, kMaxRateAdjust);
+}
+
+// Holds the last frame on underrun (slow motion, emulator stalled)
+StereoFrame AudioOutput::NextInputFrame() {
+    if (input_pos < input.size()) {
+        return input[input_pos++];
+    }
+    return next;
+}
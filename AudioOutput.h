@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "AudioRing.h"
+#include "AudioSink.h"
+
+// Moves SPU samples from the emulation thread to an audio thread through a lock-free ring.
+// The audio thread consumes them at the wall clock sample rate and resamples slightly faster
+// or slower depending on how full the ring is, so fast-forward, slow motion and timing jitter
+// never stall the emulator, they only stretch the audio by a fraction of a percent.
+class AudioOutput {
+public:
+    static const uint32_t kSampleRate = 44100;
+
+    ~AudioOutput();
+    void Start();
+    void Stop();
+
+    // Emulation thread, interleaved stereo. Frames that don't fit are dropped.
+    void Push(const int16_t* samples, size_t frames);
+    // Any thread, nullptr discards the output
+    void SetSink(std::unique_ptr<AudioSink> new_sink);
+private:
+    void Run();
+    void Produce(size_t count);
+    double GetRateRatio();
+    StereoFrame NextInputFrame();
+
+    SPSCRing<StereoFrame> ring{kRingFrames};
+    std::thread thread;
+    std::atomic<bool> running = false;
+    std::mutex sink_mutex;
+    std::unique_ptr<AudioSink> sink;
+
+    // Owned by the audio thread
+    std::vector<StereoFrame> input;
+    size_t input_pos = 0;
+    std::vector<StereoFrame> resampled;
+    StereoFrame previous{};
+    StereoFrame next{};
+    double phase = 0.0;
+    double average_fill = kTargetFill;
+
+    static const size_t kRingFrames = 8192;
+    static const size_t kTargetFill = 2048;     // ~46ms of latency
+    static const size_t kMaxFill = 4096;        // drop the excess instead of lagging behind
+    static constexpr double kMaxRateAdjust = 0.005;
+    static constexpr double kFillSmoothing = 0.05;
+    const std::chrono::milliseconds kTickInterval{10};
+    static constexpr uint64_t kMaxStallFrames = kSampleRate / 10;     // 100ms
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// Lock-free single producer/single consumer ring buffer. Both sides copy as many
+// elements as currently fit or are available and return right away, neither
+// ever waits on the other.
+template <typename T>
+class SPSCRing {
+public:
+    // capacity is rounded up to a power of two
+    explicit SPSCRing(size_t capacity) {
+        size = 1;
+        while (size < capacity) {
+            size *= 2;
+        }
+        buffer = std::make_unique<T[]>(size);
+    }
+
+    // Producer side, returns how many elements were written
+    size_t Push(const T* data, size_t count) {
+        size_t write = head.load(std::memory_order_relaxed);
+        size_t read = tail.load(std::memory_order_acquire);
+        count = std::min(count, size - (write - read));
+        size_t start = write & (size - 1);
+        size_t first = std::min(count, size - start);
+        std::copy(data, data + first, buffer.get() + start);
+        std::copy(data + first, data + count, buffer.get());
+        head.store(write + count, std::memory_order_release);
+        return count;
+    }
+
+    // Consumer side, returns how many elements were read
+    size_t Pop(T* dest, size_t max_count) {
+        size_t read = tail.load(std::memory_order_relaxed);
+        size_t write = head.load(std::memory_order_acquire);
+        size_t count = std::min(max_count, write - read);
+        size_t start = read & (size - 1);
+        size_t first = std::min(count, size - start);
+        std::copy(buffer.get() + start, buffer.get() + start + first, dest);
+        std::copy(buffer.get(), buffer.get() + (count - first), dest + first);
+        tail.store(read + count, std::memory_order_release);
+        return count;
+    }
+
+    // Either side, only a snapshot while the other side is running
+    size_t Size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+    size_t Capacity() const { return size; }
+private:
+    std::unique_ptr<T[]> buffer;
+    size_t size;
+    // Monotonic element counts, kept on separate cache lines so the two threads don't share one
+    alignas(64) std::atomic<size_t> head = 0;   // written by the producer
+    alignas(64) std::atomic<size_t> tail = 0;   // written by the consumer
+};
@@ -0,0 +1,48 @@
+#include "AudioSink.h"
+
+WAVFileSink::WAVFileSink(const std::string& path, uint32_t sample_rate) : sample_rate(sample_rate) {
+    file.open(path, std::ios::binary | std::ios::out | std::ios::trunc);
+    if (file.is_open()) {
+        WriteHeader();
+    }
+}
+
+WAVFileSink::~WAVFileSink() {
+    if (file.is_open()) {
+        file.close();
+    }
+}
+
+void WAVFileSink::Write(const StereoFrame* frames, size_t count) {
+    if (!file.is_open() || count == 0) {
+        return;
+    }
+    file.write((const char*)frames, count * sizeof(StereoFrame));
+    data_bytes += (uint32_t)(count * sizeof(StereoFrame));
+    WriteHeader();
+    file.seekp(0, std::ios::end);
+}
+
+void WAVFileSink::WriteHeader() {
+    const uint16_t channels = 2;
+    const uint16_t bits = 16;
+    const uint16_t block_align = channels * bits / 8;
+    const uint32_t byte_rate = sample_rate * block_align;
+    const uint32_t riff_size = 36 + data_bytes;
+    const uint32_t fmt_size = 16;
+    const uint16_t pcm = 1;
+
+    file.seekp(0);
+    file.write("RIFF", 4);
+    file.write((const char*)&riff_size, 4);
+    file.write("WAVEfmt ", 8);
+    file.write((const char*)&fmt_size, 4);
+    file.write((const char*)&pcm, 2);
+    file.write((const char*)&channels, 2);
+    file.write((const char*)&sample_rate, 4);
+    file.write((const char*)&byte_rate, 4);
+    file.write((const char*)&block_align, 2);
+    file.write((const char*)&bits, 2);
+    file.write("data", 4);
+    file.write((const char*)&data_bytes, 4);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+struct StereoFrame {
+    int16_t left = 0;
+    int16_t right = 0;
+};
+
+// Destination of audio frames. AudioOutput calls its sink from the audio thread with
+// the resampled real-time output
+class AudioSink {
+public:
+    virtual ~AudioSink() = default;
+    virtual void Write(const StereoFrame* frames, size_t count) = 0;
+};
+
+// 16 bit stereo PCM .wav file, the header sizes are patched on every write so
+// the file stays valid even if the emulator is killed
+class WAVFileSink : public AudioSink {
+public:
+    WAVFileSink(const std::string& path, uint32_t sample_rate);
+    ~WAVFileSink() override;
+    bool IsOpen() const { return file.is_open(); }
+    void Write(const StereoFrame* frames, size_t count) override;
+private:
+    void WriteHeader();
+
+    std::ofstream file{};
+    uint32_t sample_rate;
+    uint32_t data_bytes = 0;
+};
@@ -0,0 +1,175 @@
+#include "CDAudio.h"
+
+#include <algorithm>
+#include <cstring>
+
+// XA only uses the first four SPU ADPCM filters
+static const int kFilterPositive[4] = {0, 60, 115, 98};
+static const int kFilterNegative[4] = {0, 0, -52, -55};
+
+static const int kGroupsPerSector = 18;
+static const int kGroupSize = 128;
+static const int kSamplesPerUnit = 28;
+
+void CDAudio::QueueXASector(const uint8_t* sector) {
+    Queue(sector, true);
+}
+
+void CDAudio::QueueCDDASector(const uint8_t* sector) {
+    Queue(sector, false);
+}
+
+void CDAudio::Queue(const uint8_t* sector, bool xa) {
+    if (starved) {
+        stats.underruns++;
+        starved = false;
+    }
+    if (sectors.size() >= kMaxQueuedSectors) {
+        sectors.pop_front();
+    }
+    sectors.emplace_back();
+    memcpy(sectors.back().data.data(), sector, kSectorSize);
+    sectors.back().xa = xa;
+}
+
+void CDAudio::SetVolume(uint8_t left_to_left, uint8_t left_to_right, uint8_t right_to_left,
+    uint8_t right_to_right) {
+    volume_left_to_left = left_to_left;
+    volume_left_to_right = left_to_right;
+    volume_right_to_left = right_to_left;
+    volume_right_to_right = right_to_right;
+}
+
+void CDAudio::Reset() {
+    sectors.clear();
+    source.clear();
+    source_pos = 0;
+    phase = 0;
+    memset(xa_history, 0, sizeof(xa_history));
+    buffering = true;
+    starved = false;
+}
+
+void CDAudio::Mix(int count, int16_t* left, int16_t* right) {
+    if (buffering) {
+        if (sectors.size() < kStartSectors) {
+            std::fill(left, left + count, 0);
+            std::fill(right, right + count, 0);
+            return;
+        }
+        buffering = false;
+    }
+    for (int i = 0; i < count; i++) {
+        // Interpolating needs the current frame and the one after it
+        while (source.size() / 2 < source_pos + 2) {
+            if (!DecodeNext()) {
+                // Either the stream ended or the controller fell behind, which only shows
+                // once more sectors come in. Build up the cushion again before resuming
+                buffering = true;
+                starved = true;
+                std::fill(left + i, left + count, 0);
+                std::fill(right + i, right + count, 0);
+                return;
+            }
+        }
+        const int16_t* current = source.data() + source_pos * 2;
+        const int16_t* next = current + 2;
+        int32_t l = current[0] + (((next[0] - current[0]) * (int32_t)phase) >> 16);
+        int32_t r = current[1] + (((next[1] - current[1]) * (int32_t)phase) >> 16);
+        left[i] = (int16_t)std::clamp((l * volume_left_to_left + r * volume_right_to_left) >> 7, -0x8000, 0x7FFF);
+        right[i] = (int16_t)std::clamp((l * volume_left_to_right + r * volume_right_to_right) >> 7, -0x8000, 0x7FFF);
+
+        phase += (source_rate << 16) / kOutputRate;
+        source_pos += phase >> 16;
+        phase &= 0xFFFF;
+    }
+}
+
+bool CDAudio::DecodeNext() {
+    if (sectors.empty()) {
+        return false;
+    }
+    // Keep the frame still being interpolated from, drop everything before it
+    size_t consumed = std::min(source_pos, source.size() / 2);
+    source.erase(source.begin(), source.begin() + consumed * 2);
+    source_pos -= consumed;
+
+    const Sector& sector = sectors.front();
+    if (sector.xa) {
+        DecodeXA(sector.data.data());
+    } else {
+        DecodeCDDA(sector.data.data());
+    }
+    sectors.pop_front();
+    return true;
+}
+
+void CDAudio::DecodeXA(const uint8_t* sector) {
+    // Subheader coding info: stereo, 18.9kHz and 8 bit flags
+    uint8_t coding_info = sector[16 + 3];
+    bool stereo = (coding_info & 0x3) == 1;
+    bool half_rate = ((coding_info >> 2) & 0x3) == 1;
+    bool eight_bit = ((coding_info >> 4) & 0x3) == 1;
+    source_rate = half_rate ? 18900 : 37800;
+
+    int units = eight_bit ? 4 : 8;
+    int frames = kGroupsPerSector * units * kSamplesPerUnit / (stereo ? 2 : 1);
+    size_t start = source.size();
+    source.resize(start + frames * 2);
+    int16_t* out = source.data() + start;
+    const uint8_t* data = sector + 24;
+    for (int group = 0; group < kGroupsPerSector; group++) {
+        const uint8_t* group_data = data + group * kGroupSize;
+        for (int unit = 0; unit < units; unit++) {
+            if (stereo) {
+                // Even units are the left channel, odd ones the right
+                int channel = unit & 1;
+                DecodeXAUnit(group_data, unit, eight_bit, xa_history[channel], out + channel, 2);
+                if (channel == 1) {
+                    out += kSamplesPerUnit * 2;
+                }
+            } else {
+                DecodeXAUnit(group_data, unit, eight_bit, xa_history[0], out, 2);
+                for (int i = 0; i < kSamplesPerUnit; i++) {
+                    out[i * 2 + 1] = out[i * 2];
+                }
+                out += kSamplesPerUnit * 2;
+            }
+        }
+    }
+}
+
+// One sound unit of a 128 byte sound group, the 28 samples of a unit are interleaved
+// with the other units of the group a byte (8 bit) or a nibble (4 bit) at a time
+void CDAudio::DecodeXAUnit(const uint8_t* group, int unit, bool eight_bit, int16_t history[2],
+    int16_t* out, int stride) {
+    uint8_t header = group[4 + unit];
+    int shift = header & 0xF;
+    if (shift > 12) {
+        shift = 9;
+    }
+    int filter = (header >> 4) & 0x3;
+    int32_t pos = kFilterPositive[filter];
+    int32_t neg = kFilterNegative[filter];
+    for (int i = 0; i < kSamplesPerUnit; i++) {
+        int16_t raw;
+        if (eight_bit) {
+            raw = (int16_t)(group[16 + i * 4 + unit] << 8);
+        } else {
+            uint8_t byte = group[16 + i * 4 + unit / 2];
+            raw = (int16_t)((unit & 1) ? (byte & 0xF0) << 8 : byte << 12);
+        }
+        int32_t sample = (raw >> shift) + ((history[0] * pos + history[1] * neg + 32) >> 6);
+        history[1] = history[0];
+        history[0] = (int16_t)std::clamp(sample, -0x8000, 0x7FFF);
+        out[i * stride] = history[0];
+    }
+}
+
+void CDAudio::DecodeCDDA(const uint8_t* sector) {
+    // Plain 16 bit stereo, 588 frames per sector
+    source_rate = kOutputRate;
+    size_t start = source.size();
+    source.resize(start + kSectorSize / 2);
+    memcpy(source.data() + start, sector, kSectorSize);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Audio the CD controller sends to the SPU's CD input: XA-ADPCM sectors and CD-DA.
+// The controller only queues raw sectors as it reads them, they are decoded and
+// resampled to 44.1kHz in batches whenever the SPU mixes
+class CDAudio {
+public:
+    static constexpr size_t kSectorSize = 2352;
+
+    // Raw sectors including the sync and header
+    void QueueXASector(const uint8_t* sector);
+    void QueueCDDASector(const uint8_t* sector);
+    // CD volume matrix, 80h = 100%
+    void SetVolume(uint8_t left_to_left, uint8_t left_to_right, uint8_t right_to_left, uint8_t right_to_right);
+    // Drops everything queued, the next XA sector starts with a fresh filter history
+    void Reset();
+    // Produces count 44.1kHz frames after the volume matrix, silence once the queue runs dry
+    void Mix(int count, int16_t* left, int16_t* right);
+
+    // Times the queue ran dry in the middle of a stream, should stay 0 while the
+    // controller keeps up with the sector rate
+    struct Stats {
+        uint64_t underruns = 0;
+    };
+    const Stats& GetStats() const { return stats; }
+private:
+    struct Sector {
+        std::array<uint8_t, kSectorSize> data;
+        bool xa;
+    };
+
+    void Queue(const uint8_t* sector, bool xa);
+    bool DecodeNext();
+    void DecodeXA(const uint8_t* sector);
+    void DecodeXAUnit(const uint8_t* group, int unit, bool eight_bit, int16_t history[2], int16_t* out,
+        int stride);
+    void DecodeCDDA(const uint8_t* sector);
+
+    std::deque<Sector> sectors;
+    std::vector<int16_t> source;    // decoded interleaved stereo at source_rate
+    size_t source_pos = 0;          // frame index into source
+    uint32_t source_rate = 44100;
+    uint32_t phase = 0;             // position between source_pos and the next frame, 16 bit fraction
+    int16_t xa_history[2][2] = {};  // previous two samples per channel
+    bool buffering = true;          // silent until kStartSectors are queued
+    bool starved = false;           // ran dry, the next queued sector is an underrun
+    Stats stats;
+
+    uint8_t volume_left_to_left = 0x80;
+    uint8_t volume_left_to_right = 0;
+    uint8_t volume_right_to_left = 0;
+    uint8_t volume_right_to_right = 0x80;
+
+    static constexpr size_t kMaxQueuedSectors = 32;
+    // Sectors arrive exactly as fast as they play, the second one covers the delivery
+    // jitter and the frame interpolation looks ahead
+    static constexpr size_t kStartSectors = 2;
+    static constexpr uint32_t kOutputRate = 44100;
+};
@@ -2,8 +2,6 @@
 #include "PSX.h"
 #include <assert.h>
 
-#define LOAD_EXE 0
-
 CPU::CPU(PSX* system) : system(system), next_inst(0) {
     PC = current_PC = 0xBFC00000;
     next_PC = PC + 4;
@@ -26,6 +24,10 @@ void CPU::SetReg(uint32_t regnum, uint32_t data) {
     registers[regnum] = data;
 }
 
+void CPU::EnableFastBoot() {
+    fast_boot = true;
+}
+
 void CPU::AddBreakpoint(uint32_t bp) {
     breakpoints.push_back(bp);
 }
@@ -34,9 +36,6 @@ bool CPU::DidHitBreakpoint() {
     for (int i = 0; i < breakpoints.size(); i++) {
         if (breakpoints[i] == PC) {
             breakpoints.erase(breakpoints.begin() + i);
-            if (PC == 0x80030000) {
-                SetPC(registers[31]);
-            }
             return true;
         }
     }
@@ -46,11 +45,11 @@ bool CPU::DidHitBreakpoint() {
 bool CPU::RunInstructions(int instructions) {
     for (int i = 0; i < instructions; i++) {
         current_PC = PC;
-#if LOAD_EXE
-        if (PC == 0x80030000) {
-            system->LoadExeToCPU();
+        // The kernel is set up by the time the BIOS jumps to the shell
+        if (fast_boot && PC == kShellEntry) {
+            fast_boot = false;
+            system->FastBoot();
         }
-#endif // LOAD_EXE
 
         delay_slot = branch;
         branch = false;
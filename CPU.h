@@ -17,9 +17,14 @@ public:
     void DecodeAndExecute(uint32_t instruction);
     void SetPC(uint32_t new_pc);
     void SetReg(uint32_t regnum, uint32_t data);
+    // Calls PSX::FastBoot instead of entering the BIOS shell
+    void EnableFastBoot();
     void AddBreakpoint(uint32_t bp);
 private:
+    static const uint32_t kShellEntry = 0x80030000;
+
     PSX* system = nullptr;
+    bool fast_boot = false;
     cop0 COP0;
     GTE gte;
 
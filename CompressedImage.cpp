@@ -0,0 +1,131 @@
+#include "CompressedImage.h"
+#include "LZCodec.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+bool CompressedImage::Create(const uint8_t* data, size_t size, const std::string& path) {
+    std::ofstream out(path, std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!out.is_open()) {
+        printf("Could not open %s\n", path.c_str());
+        return false;
+    }
+    Header header;
+    header.magic = kMagic;
+    header.version = kVersion;
+    header.sector_count = (uint32_t)(size / kSectorSize);
+    header.hunk_sectors = kHunkSectors;
+    uint32_t hunks = (header.sector_count + kHunkSectors - 1) / kHunkSectors;
+
+    // The offset table is written last, once all the sizes are known
+    std::vector<uint64_t> offsets(hunks + 1);
+    uint64_t offset = sizeof(Header) + offsets.size() * sizeof(uint64_t);
+    out.seekp(offset);
+    std::vector<uint8_t> compressed(kHunkSize);
+    for (uint32_t hunk = 0; hunk < hunks; hunk++) {
+        const uint8_t* raw = data + (size_t)hunk * kHunkSize;
+        uint32_t raw_size = std::min(header.sector_count - hunk * kHunkSectors, kHunkSectors) * kSectorSize;
+        // Only kept if it actually shrinks, an equal size means stored
+        size_t compressed_size = LZCodec::Compress(raw, raw_size, compressed.data(), raw_size - 1);
+        offsets[hunk] = offset;
+        if (compressed_size != 0) {
+            out.write((const char*)compressed.data(), compressed_size);
+            offset += compressed_size;
+        } else {
+            out.write((const char*)raw, raw_size);
+            offset += raw_size;
+        }
+    }
+    offsets[hunks] = offset;
+    out.seekp(0);
+    out.write((const char*)&header, sizeof(header));
+    out.write((const char*)offsets.data(), offsets.size() * sizeof(uint64_t));
+    return out.good();
+}
+
+bool CompressedImage::Open(const std::string& path) {
+    if (!file.Open(path)) {
+        return false;
+    }
+    Header header;
+    bool valid = file.GetSize() >= sizeof(Header);
+    if (valid) {
+        memcpy(&header, file.GetData(), sizeof(header));
+        valid = header.magic == kMagic && header.version == kVersion && header.hunk_sectors == kHunkSectors;
+    }
+    if (valid) {
+        hunk_count = (header.sector_count + kHunkSectors - 1) / kHunkSectors;
+        valid = file.GetSize() >= sizeof(Header) + (hunk_count + 1) * sizeof(uint64_t);
+    }
+    if (!valid) {
+        printf("%s is not a compressed disc image\n", path.c_str());
+        file.Close();
+        return false;
+    }
+    sector_count = header.sector_count;
+    hunk_offsets = (const uint64_t*)(file.GetData() + sizeof(Header));
+    return true;
+}
+
+const uint8_t* CompressedImage::ReadSector(uint32_t sector) {
+    if (sector >= sector_count) {
+        return nullptr;
+    }
+    uint32_t hunk = sector / kHunkSectors;
+    CachedHunk* cached = last_hunk;
+    if (cached == nullptr || cached->hunk != hunk) {
+        cached = LoadHunk(hunk);
+        if (cached == nullptr) {
+            return nullptr;
+        }
+    } else {
+        cache_stats.hits++;
+    }
+    cached->last_used = ++use_counter;
+    last_hunk = cached;
+    return cached->data.data() + (sector % kHunkSectors) * kSectorSize;
+}
+
+CompressedImage::CachedHunk* CompressedImage::LoadHunk(uint32_t hunk) {
+    CachedHunk* victim = &cache[0];
+    for (CachedHunk& entry : cache) {
+        if (entry.hunk == hunk) {
+            cache_stats.hits++;
+            return &entry;
+        }
+        if (entry.last_used < victim->last_used) {
+            victim = &entry;
+        }
+    }
+    cache_stats.misses++;
+
+    uint64_t start = hunk_offsets[hunk];
+    uint64_t end = hunk_offsets[hunk + 1];
+    uint32_t raw_size = std::min(sector_count - hunk * kHunkSectors, kHunkSectors) * kSectorSize;
+    if (start > end || end > file.GetSize()) {
+        printf("Corrupt hunk %u in compressed disc image\n", hunk);
+        return nullptr;
+    }
+    victim->hunk = kNoHunk;
+    victim->data.resize(kHunkSize);
+    const uint8_t* src = file.GetData() + start;
+    if (end - start == raw_size) {
+        memcpy(victim->data.data(), src, raw_size);
+    } else if (!LZCodec::Decompress(src, end - start, victim->data.data(), raw_size)) {
+        printf("Corrupt hunk %u in compressed disc image\n", hunk);
+        return nullptr;
+    }
+    victim->hunk = hunk;
+    return victim;
+}
+
+void CompressedImage::Prefetch(uint32_t sector, uint32_t count) const {
+    if (sector >= sector_count || count == 0) {
+        return;
+    }
+    uint32_t first = sector / kHunkSectors;
+    uint32_t last = std::min(sector + count - 1, sector_count - 1) / kHunkSectors;
+    file.Prefetch(hunk_offsets[first], hunk_offsets[last + 1] - hunk_offsets[first]);
+}
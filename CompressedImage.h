@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+
+// Compressed raw disc image (.cdz). Sectors are grouped into hunks of kHunkSectors
+// that are compressed independently with LZCodec, a table of hunk offsets after the
+// header allows random access. Hunks that don't shrink are stored as is.
+//
+//   Header
+//   uint64_t hunk_offsets[hunk_count + 1]    absolute file offsets, the last one is the file end
+//   hunk data
+class CompressedImage {
+public:
+    static constexpr uint32_t kMagic = 0x315A4443;     // "CDZ1"
+    static constexpr uint32_t kVersion = 1;
+    static constexpr uint32_t kSectorSize = 2352;
+    static constexpr uint32_t kHunkSectors = 16;
+    static constexpr uint32_t kHunkSize = kHunkSectors * kSectorSize;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t sector_count;
+        uint32_t hunk_sectors;
+    };
+
+    struct CacheStats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+
+    // Compresses a raw 2352 byte/sector image into path
+    static bool Create(const uint8_t* data, size_t size, const std::string& path);
+
+    bool Open(const std::string& path);
+    uint32_t GetSectorCount() const { return sector_count; }
+    // nullptr if the hunk is corrupt. The sector stays valid until kCacheHunks other
+    // hunks have been read
+    const uint8_t* ReadSector(uint32_t sector);
+    // Pages in the compressed data of upcoming sectors
+    void Prefetch(uint32_t sector, uint32_t count) const;
+    const CacheStats& GetCacheStats() const { return cache_stats; }
+private:
+    static constexpr uint32_t kCacheHunks = 32;
+    static constexpr uint32_t kNoHunk = ~0u;
+
+    // Least recently used entry gets evicted
+    struct CachedHunk {
+        uint32_t hunk = kNoHunk;
+        uint64_t last_used = 0;
+        std::vector<uint8_t> data;
+    };
+
+    CachedHunk* LoadHunk(uint32_t hunk);
+
+    MappedFile file;
+    const uint64_t* hunk_offsets = nullptr;    // points into the mapping
+    uint32_t sector_count = 0;
+    uint32_t hunk_count = 0;
+    std::array<CachedHunk, kCacheHunks> cache;
+    CachedHunk* last_hunk = nullptr;           // sequential reads stay in the same hunk
+    uint64_t use_counter = 0;
+    CacheStats cache_stats;
+};
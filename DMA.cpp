@@ -1,6 +1,7 @@
 #include "DMA.h"
 #include "PSX.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 
@@ -14,11 +15,102 @@ void DMA::Init(RAM* ram, PSX* sys, IRQ* irq, GPU* gpu, cdrom* CDROM, SPU* spu, M
     this->mdec = mdec;
 }
 
-void DMA::Cycle() {
+uint32_t DMA::Cycle(uint32_t cycles) {
+    uint32_t stolen = 0;
+    while (cycles > 0) {
+        int channel = GetNextChannel();
+        uint32_t elapsed = cycles;
+        if (channel >= 0) {
+            ScheduledTransfer& transfer = transfers[channel];
+            elapsed = std::min(elapsed, transfer.cycles_left);
+            if (transfer.chunk_cycles) {
+                elapsed = std::min(elapsed, transfer.chunk_cycles_left);
+            }
+        } else {
+            // Only chopped transfers waiting for their CPU window are left, if any
+            bool waiting = false;
+            for (const ScheduledTransfer& transfer : transfers) {
+                if (transfer.busy && transfer.cpu_cycles_left) {
+                    elapsed = std::min(elapsed, transfer.cpu_cycles_left);
+                    waiting = true;
+                }
+            }
+            if (!waiting) {
+                break;
+            }
+        }
+
+        for (ScheduledTransfer& transfer : transfers) {
+            if (transfer.busy && transfer.cpu_cycles_left) {
+                transfer.cpu_cycles_left -= std::min(elapsed, transfer.cpu_cycles_left);
+            }
+        }
+        cycles -= elapsed;
+        if (channel < 0) {
+            continue;
+        }
+        stolen += elapsed;
+        DMAChannel::DMAChannelControl& control = channels[channel].control;
+        ScheduledTransfer& transfer = transfers[channel];
+        transfer.cycles_left -= elapsed;
+        if (transfer.cycles_left == 0) {
+            FinishTransfer(channel);
+        } else if (transfer.chunk_cycles) {
+            transfer.chunk_cycles_left -= elapsed;
+            if (transfer.chunk_cycles_left == 0) {
+                transfer.chunk_cycles_left = transfer.chunk_cycles;
+                transfer.cpu_cycles_left = 1 << control.flags.chopping_cpu_size;
+            }
+        }
+    }
     if (trigger) {
         irq->TriggerIRQ(3);
         trigger = false;
     }
+    return stolen;
+}
+
+int DMA::GetNextChannel() const {
+    // Lower priority values win, on a tie the higher channel number wins
+    int next = -1;
+    uint32_t next_priority = 8;
+    for (int channel = 6; channel >= 0; channel--) {
+        const ScheduledTransfer& transfer = transfers[channel];
+        uint32_t priority = (DMA_control.reg >> (channel * 4)) & 0x7;
+        if (transfer.busy && transfer.cpu_cycles_left == 0 && priority < next_priority) {
+            next = channel;
+            next_priority = priority;
+        }
+    }
+    return next;
+}
+
+void DMA::ScheduleTransfer(uint32_t channel, uint32_t words) {
+    ScheduledTransfer& transfer = transfers[channel];
+    transfer.busy = true;
+    transfer.cycles_left = std::max(1u, (words * kCyclesPer256Words[channel]) >> 8);
+    transfer.chunk_cycles = 0;
+    transfer.chunk_cycles_left = 0;
+    transfer.cpu_cycles_left = 0;
+    const DMAChannel::DMAChannelControl& control = channels[channel].control;
+    if (control.flags.chopping_enable) {
+        uint32_t chunk_words = 1 << control.flags.chopping_dma_size;
+        transfer.chunk_cycles = std::max(1u, (chunk_words * kCyclesPer256Words[channel]) >> 8);
+        transfer.chunk_cycles_left = transfer.chunk_cycles;
+    }
+}
+
+void DMA::FinishTransfer(uint32_t channel) {
+    transfers[channel].busy = false;
+    channels[channel].FinishTransfer();
+    if (DMA_interrupt.irq_enable & (1 << channel) || DMA_interrupt.irq_master_enable) {
+        DMA_interrupt.irq_flags |= (1 << channel);
+    }
+    // Check if channel is enabled
+    if (DMA_interrupt.reg & (0x10000 << channel)) {
+        DMA_interrupt.reg |= (0x1000000 << channel);
+        trigger = GetMasterFlag();
+    }
 }
 
 void DMA::Write32(uint32_t offset, uint32_t data) {
@@ -39,7 +131,10 @@ void DMA::Write32(uint32_t offset, uint32_t data) {
                 assert(false);
                 break;
             }
-        if (channels[channel].IsActive()) {
+        if (transfers[channel].busy && !channels[channel].control.flags.enable) {
+            // Stopped by the CPU before it completed
+            transfers[channel].busy = false;
+        } else if (channels[channel].IsActive() && !transfers[channel].busy) {
             DoTransfer(channel);
         }
     }
@@ -112,13 +207,14 @@ void DMA::DoTransfer(uint32_t channel) {
     assert(channel <= 6);
     DMAChannel& curr_channel = channels[channel];
     DMAChannel::SyncMode sync_mode = curr_channel.control.flags.sync_mode;
+    uint32_t words = 0;
     switch (sync_mode) {
         case DMAChannel::SyncMode::Manual:
         case DMAChannel::SyncMode::Sync:
-            DoManualTransfer(channel);
+            words = DoManualTransfer(channel);
             break;
         case DMAChannel::SyncMode::LinkedList:
-            DoLinkedTransfer(channel);
+            words = DoLinkedTransfer(channel);
             break;
         default:
             const char* mode = DMAChannel::SyncModeToString(sync_mode);
@@ -126,51 +222,67 @@ void DMA::DoTransfer(uint32_t channel) {
             assert(false);
             break;
     }
-    // Check if channel is enabled
-    if (DMA_interrupt.reg & (0x10000 << channel)) {
-        DMA_interrupt.reg |= (0x1000000 << channel);
-        trigger = GetMasterFlag();
+    ScheduleTransfer(channel, words);
+}
+
+uint32_t* DMA::GetRAMWords(uint32_t lowest_addr, uint32_t size) {
+    // Validates the whole transfer once, nullptr if it leaves main RAM
+    uint32_t addr = lowest_addr & 0x00FFFFFC;
+    if (addr + (uint64_t)size * 4 > RAM_START_ADDRESS + RAM_SIZE) {
+        return nullptr;
     }
+    return (uint32_t*)ram->GetPointer(addr - RAM_START_ADDRESS);
 }
 
-void DMA::DoManualTransfer(uint32_t channel) {
+uint32_t DMA::DoManualTransfer(uint32_t channel) {
     DMAChannel& curr_channel = channels[channel];
     uint32_t inc = curr_channel.control.flags.mem_addr_step ? -4 : 4;
     uint32_t size = curr_channel.GetTransferLength();
     uint32_t addr = curr_channel.dma_base_address & 0x00FFFFFF;
     DMAChannel::TransferDirection transfer_direction = curr_channel.control.flags.transfer_dir;
     Channel ch = static_cast<Channel>(channel);
+    // Forward transfers can work on main RAM directly
+    uint32_t* words = inc == 4 ? GetRAMWords(addr, size) : nullptr;
 
     if (transfer_direction == DMAChannel::TransferDirection::ToRAM) {
         if (ch == Channel::OTC) {
-            for (int i = size - 1; i >= 0; i--, addr += inc) {
-                uint32_t src = (addr - 4) & 0x00FFFFFC;
-                if (i == 0) {
-                    src = 0x00FFFFFF;
+            // The table is built backwards, from addr down to its end marker
+            uint32_t lowest_addr = (addr - (size - 1) * 4) & 0x00FFFFFC;
+            uint32_t* table = size > 0 && inc == (uint32_t)-4 && size * 4 <= addr + 4
+                ? GetRAMWords(lowest_addr, size) : nullptr;
+            if (table) {
+                table[0] = 0x00FFFFFF;
+                for (uint32_t i = 1; i < size; i++) {
+                    table[i] = lowest_addr + (i - 1) * 4;
+                }
+            } else {
+                for (int i = size - 1; i >= 0; i--, addr += inc) {
+                    uint32_t src = (addr - 4) & 0x00FFFFFC;
+                    if (i == 0) {
+                        src = 0x00FFFFFF;
+                    }
+                    sys->Write32(addr, src);
                 }
-                sys->Write32(addr, src);
-            }
-            curr_channel.FinishTransfer();
-            if (DMA_interrupt.irq_enable & (1 << channel) || DMA_interrupt.irq_master_enable) {
-                DMA_interrupt.irq_flags |= (1 << channel);
             }
         } else if (ch == Channel::GPU) {
-            for (int i = size - 1; i >= 0; i--, addr += inc) {
-                uint32_t src = gpu->ReadVRAM();
-                sys->Write32(addr, src);
-            }
-            curr_channel.FinishTransfer();
-            if (DMA_interrupt.irq_enable & (1 << channel) || DMA_interrupt.irq_master_enable) {
-                DMA_interrupt.irq_flags |= (1 << channel);
+            if (words) {
+                for (uint32_t i = 0; i < size; i++) {
+                    words[i] = gpu->ReadVRAM();
+                }
+            } else {
+                for (int i = size - 1; i >= 0; i--, addr += inc) {
+                    uint32_t src = gpu->ReadVRAM();
+                    sys->Write32(addr, src);
+                }
             }
         } else if (ch == Channel::CDROM) {
-            for (int i = size - 1; i >= 0; i--, addr += inc) {
-                uint32_t src = CDROM->GetWord();
-                sys->Write32(addr, src);
-            }
-            curr_channel.FinishTransfer();
-            if (DMA_interrupt.irq_enable & (1 << channel) || DMA_interrupt.irq_master_enable) {
-                DMA_interrupt.irq_flags |= (1 << channel);
+            if (words) {
+                CDROM->ReadWords(std::span<uint32_t>(words, size));
+            } else {
+                for (int i = size - 1; i >= 0; i--, addr += inc) {
+                    uint32_t src = CDROM->GetWord();
+                    sys->Write32(addr, src);
+                }
             }
         } else {
             const char* mode = DMAChannel::TransferDirToString(transfer_direction);
@@ -179,32 +291,31 @@ void DMA::DoManualTransfer(uint32_t channel) {
         }
     } else {    // handle transfer from RAM
         if (ch == Channel::GPU) {
-            for (uint32_t i = 0; i < size; i++, addr += inc) {
-                uint32_t cmd = sys->Read32(addr);
-                gpu->GP0Command(cmd);
-            }
-            curr_channel.FinishTransfer();
-            if (DMA_interrupt.irq_enable & (1 << channel) || DMA_interrupt.irq_master_enable) {
-                DMA_interrupt.irq_flags |= (1 << channel);
+            if (words) {
+                gpu->GP0Commands(words, size);
+            } else {
+                for (uint32_t i = 0; i < size; i++, addr += inc) {
+                    uint32_t cmd = sys->Read32(addr);
+                    gpu->GP0Command(cmd);
+                }
             }
         } else if (ch == Channel::SPU) {
-            for (uint32_t i = 0; i < size; i++, addr += inc) {
-                uint32_t src = sys->Read32(addr);
-                spu->Write16(0x1F801DA8, src >> 16);
-                spu->Write16(0x1F801DA8, src >> 0);
-            }
-            curr_channel.FinishTransfer();
-            if (DMA_interrupt.irq_enable & (1 << channel) || DMA_interrupt.irq_master_enable) {
-                DMA_interrupt.irq_flags |= (1 << channel);
+            if (words) {
+                spu->DMAWrite(words, size);
+            } else {
+                for (uint32_t i = 0; i < size; i++, addr += inc) {
+                    uint32_t src = sys->Read32(addr);
+                    spu->DMAWrite(&src, 1);
+                }
             }
         } else if (ch == Channel::MDECIn) {
-            for (uint32_t i = 0; i < size; i++, addr += inc) {
-                uint32_t data = sys->Read32(addr);
-                mdec->Write32(0, data);
-            }
-            curr_channel.FinishTransfer();
-            if (DMA_interrupt.irq_enable & (1 << channel) || DMA_interrupt.irq_master_enable) {
-                DMA_interrupt.irq_flags |= (1 << channel);
+            if (words) {
+                mdec->WriteWords(words, size);
+            } else {
+                for (uint32_t i = 0; i < size; i++, addr += inc) {
+                    uint32_t data = sys->Read32(addr);
+                    mdec->Write32(0, data);
+                }
             }
         } else {
             const char* mode = DMAChannel::TransferDirToString(transfer_direction);
@@ -212,33 +323,52 @@ void DMA::DoManualTransfer(uint32_t channel) {
             assert(false);
         }
     }
+    return size;
 }
 
-void DMA::DoLinkedTransfer(uint32_t channel) {
+uint32_t DMA::DoLinkedTransfer(uint32_t channel) {
     DMAChannel& curr_channel = channels[channel];
-    uint32_t inc = curr_channel.control.flags.mem_addr_step ? -4 : 4;
     uint32_t addr = curr_channel.dma_base_address;
     DMAChannel::TransferDirection transfer_direction = curr_channel.control.flags.transfer_dir;
+    uint32_t words = 0;
     
     if (transfer_direction == DMAChannel::TransferDirection::FromRAM) {
         Channel ch = static_cast<Channel>(channel);
         if (ch == Channel::GPU) {
+            const uint32_t* ram_words = (const uint32_t*)ram->GetPointer(0);
+            const uint32_t ram_mask = RAM_SIZE - 4;
+            // A node reached twice means the list loops, hardware would hang sending it forever
             // loop as long as the address is not the end marker
             while (addr != 0x00FFFFFF && addr != 0) {
-                uint32_t header = sys->Read32(addr);
-                uint32_t size = header >> 24;
-                for (uint32_t i = 0; i < size; i++) {
-                    addr = (addr + inc) & 0x00FFFFFC;
-                    uint32_t cmd = sys->Read32(addr);
-                    gpu->GP0Command(cmd);
+                uint32_t node = addr & ram_mask;
+                if (linked_list_visited.test(node / 4)) {
+                    printf("GPU linked list DMA loops back to node %08x, aborting\n", node);
+                    break;
                 }
+                linked_list_visited.set(node / 4);
+                linked_list_nodes.push_back(node / 4);
+                uint32_t header = ram_words[node / 4];
+                uint32_t size = header >> 24;
                 addr = header & 0x00FFFFFF;
+                words += 1 + size;
+                // Most nodes are cleared ordering table entries that only link to the next one
+                if (size == 0) {
+                    continue;
+                }
+                uint32_t payload = node + 4;
+                if (payload + size * 4 <= RAM_SIZE) {
+                    gpu->GP0Commands(ram_words + payload / 4, size);
+                } else {
+                    for (uint32_t i = 0; i < size; i++) {
+                        gpu->GP0Command(ram_words[((payload + i * 4) & ram_mask) / 4]);
+                    }
+                }
             }
-            curr_channel.dma_base_address = addr;
-            curr_channel.FinishTransfer();
-            if (DMA_interrupt.irq_enable & (1 << channel) || DMA_interrupt.irq_master_enable) {
-                DMA_interrupt.irq_flags |= (1 << channel);
+            for (uint32_t visited : linked_list_nodes) {
+                linked_list_visited.reset(visited);
             }
+            linked_list_nodes.clear();
+            curr_channel.dma_base_address = addr;
         } else {
             const char* mode = DMAChannel::TransferDirToString(transfer_direction);
             printf("Attempt to initiate linked DMA Transfer: direction %s, channel %d\n", mode, channel);
@@ -249,4 +379,5 @@ void DMA::DoLinkedTransfer(uint32_t channel) {
         printf("Attempt to initiate linked DMA Transfer: direction %s, channel %d\n", mode, channel);
         assert(false);
     }
-}
\ No newline at end of file
+    return words;
+}
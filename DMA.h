@@ -2,6 +2,8 @@
 
 #include <cstdint>
 #include <array>
+#include <bitset>
+#include <vector>
 #include "DMAChannel.h"
 #include "RAM.h"
 #include "IRQ.h"
@@ -15,13 +17,15 @@ class PSX;
 class DMA {
 public:
     void Init(RAM* ram, PSX* sys, IRQ* irq, GPU* gpu, cdrom* CDROM, SPU* spu, MDEC* mdec);
-    void Cycle();
+    // Advances running transfers, returns the cycles the DMA held the bus
+    uint32_t Cycle(uint32_t cycles);
     void Write32(uint32_t offset, uint32_t data);
     uint32_t Read32(uint32_t offset) const;
 
     void DoTransfer(uint32_t channel);
-    void DoManualTransfer(uint32_t channel);
-    void DoLinkedTransfer(uint32_t channel);
+    // Both return the number of words moved over the bus
+    uint32_t DoManualTransfer(uint32_t channel);
+    uint32_t DoLinkedTransfer(uint32_t channel);
 private:
     bool trigger = false;
     enum class Channel : uint32_t {
@@ -42,9 +46,31 @@ private:
     SPU* spu;
     MDEC* mdec;
     std::array<DMAChannel, 7> channels;
+    // Nodes seen by the current linked list transfer, one bit per word of RAM. Only the
+    // bits in linked_list_nodes get cleared afterwards, so a walk costs as much as the list
+    std::bitset<RAM_SIZE / 4> linked_list_visited;
+    std::vector<uint32_t> linked_list_nodes;
+
+    // Data moves as soon as a transfer starts, but the channel stays busy and holds
+    // the bus for as long as the transfer would take on hardware
+    struct ScheduledTransfer {
+        bool busy = false;
+        uint32_t cycles_left = 0;       // bus cycles until the transfer completes
+        uint32_t chunk_cycles = 0;      // bus cycles per chopping block, 0 when not chopping
+        uint32_t chunk_cycles_left = 0;
+        uint32_t cpu_cycles_left = 0;   // bus released to the CPU between chopping blocks
+    };
+    std::array<ScheduledTransfer, 7> transfers;
+    // Approximate bus cycles per 0x100 words for each channel
+    const uint32_t kCyclesPer256Words[7] = {0x110, 0x110, 0x110, 0x2800, 0x420, 0x1400, 0x110};
+
+    void ScheduleTransfer(uint32_t channel, uint32_t words);
+    void FinishTransfer(uint32_t channel);
+    int GetNextChannel() const;
 
     bool GetMasterFlag() const;
     uint32_t GetInterruptReg() const;
+    uint32_t* GetRAMWords(uint32_t lowest_addr, uint32_t size);
 
     union ControlReg {
         uint32_t reg = 0x07654321;
@@ -1,23 +1,252 @@
 #include "Disk.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+// Pregaps that aren't stored in the image read back as silence
+static const uint8_t kZeroSector[Disk::kSectorSize] = {};
+
+static uint32_t ParseMSF(const std::string& msf) {
+    unsigned int mm = 0, ss = 0, ff = 0;
+    sscanf(msf.c_str(), "%u:%u:%u", &mm, &ss, &ff);
+    return (mm * 60 + ss) * 75 + ff;
+}
+
+static std::string GetExtension(const std::string& path) {
+    std::string extension = std::filesystem::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension;
+}
+
+static bool IsCompressed(const std::string& path) {
+    return GetExtension(path) == ".cdz";
+}
+
 void Disk::LoadGame(const std::string& path) {
-    game_file = std::ifstream(path, std::ios::binary | std::ios::in);
-    game_file.seekg(0, game_file.end);
-    auto size = game_file.tellg();
-    game_file.seekg(0, game_file.beg);
-
-    data.resize(size);
-    if (game_file.is_open()) {
-        game_file.read((char*)data.data(), size);
-    }
-    game_file.close();
-}
-
-std::vector<uint8_t> Disk::read(uint32_t pos) {
-    std::vector<uint8_t> read_data(2352);
-    game_file.seekg(pos);
-    game_file.read((char*)read_data.data(), 2352);
-    int offset = pos * 2352;
-    read_data.assign((data.begin() + offset), data.begin() + offset + 2352);
-    return read_data;
-}
\ No newline at end of file
+    files.clear();
+    tracks.clear();
+    extents.clear();
+    lead_out = 0;
+
+    std::vector<CueTrack> cue_tracks;
+    if (GetExtension(path) == ".cue") {
+        if (!ParseCue(path, cue_tracks)) {
+            files.clear();
+            return;
+        }
+    } else {
+        CueTrack cue_track;
+        cue_track.track.number = 1;
+        cue_track.file_index = AddFile(path);
+        cue_track.index1 = 0;
+        cue_tracks.push_back(cue_track);
+    }
+    BuildLayout(cue_tracks);
+}
+
+bool Disk::ParseCue(const std::string& path, std::vector<CueTrack>& cue_tracks) {
+    std::ifstream cue(path);
+    if (!cue.is_open()) {
+        printf("Could not open %s\n", path.c_str());
+        return false;
+    }
+    // FILE names are relative to the sheet
+    std::filesystem::path directory = std::filesystem::path(path).parent_path();
+    int32_t file_index = -1;
+    std::string line;
+    while (std::getline(cue, line)) {
+        std::istringstream tokens(line);
+        std::string command;
+        tokens >> command;
+        if (command == "FILE") {
+            std::string name, type;
+            tokens >> std::ws;
+            if (tokens.peek() == '"') {
+                tokens.get();
+                std::getline(tokens, name, '"');
+            } else {
+                tokens >> name;
+            }
+            tokens >> type;
+            if (type != "BINARY") {
+                printf("Unsupported CUE file type %s for %s\n", type.c_str(), name.c_str());
+                return false;
+            }
+            file_index = AddFile((directory / name).string());
+        } else if (command == "TRACK") {
+            int number = 0;
+            std::string type;
+            tokens >> number >> type;
+            if (file_index < 0 || (type != "AUDIO" && type != "MODE1/2352" && type != "MODE2/2352")) {
+                printf("Unsupported CUE track %02d %s\n", number, type.c_str());
+                return false;
+            }
+            CueTrack cue_track;
+            cue_track.track.number = (uint8_t)number;
+            cue_track.track.audio = type == "AUDIO";
+            cue_track.file_index = file_index;
+            cue_tracks.push_back(cue_track);
+        } else if (command == "INDEX" && !cue_tracks.empty()) {
+            int number = 0;
+            std::string msf;
+            tokens >> number >> msf;
+            // Only INDEX 00 and 01 affect the layout
+            if (number == 0) {
+                cue_tracks.back().index0 = ParseMSF(msf);
+            } else if (number == 1) {
+                cue_tracks.back().index1 = ParseMSF(msf);
+            }
+        } else if (command == "PREGAP" && !cue_tracks.empty()) {
+            std::string msf;
+            tokens >> msf;
+            cue_tracks.back().pregap = ParseMSF(msf);
+        } else if (command == "POSTGAP" && !cue_tracks.empty()) {
+            std::string msf;
+            tokens >> msf;
+            cue_tracks.back().postgap = ParseMSF(msf);
+        }
+        // REM, CATALOG, FLAGS, TITLE etc. don't matter to the emulator
+    }
+
+    for (const CueTrack& cue_track : cue_tracks) {
+        if (cue_track.index1 < 0) {
+            printf("CUE track %02d has no INDEX 01\n", cue_track.track.number);
+            return false;
+        }
+    }
+    if (cue_tracks.empty()) {
+        printf("No tracks in %s\n", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+void Disk::BuildLayout(const std::vector<CueTrack>& cue_tracks) {
+    auto add_gap = [this](uint32_t start_lba, uint32_t count) {
+        if (count != 0) {
+            extents.push_back({start_lba, count, kNoFile, 0});
+        }
+    };
+
+    add_gap(0, kLeadInSectors);
+    uint32_t lba = kLeadInSectors;
+    for (size_t i = 0; i < cue_tracks.size(); i++) {
+        const CueTrack& cue_track = cue_tracks[i];
+        add_gap(lba, cue_track.pregap);
+        lba += cue_track.pregap;
+
+        // A track runs from its first index up to the next track in the same file
+        uint32_t first_sector = cue_track.index0 >= 0 ? cue_track.index0 : cue_track.index1;
+        uint32_t end_sector = files[cue_track.file_index].sector_count;
+        if (i + 1 < cue_tracks.size() && cue_tracks[i + 1].file_index == cue_track.file_index) {
+            const CueTrack& next = cue_tracks[i + 1];
+            end_sector = next.index0 >= 0 ? next.index0 : next.index1;
+        }
+        end_sector = std::max(end_sector, first_sector);
+
+        Track track = cue_track.track;
+        track.start_lba = lba + (cue_track.index1 - first_sector);
+        tracks.push_back(track);
+        if (end_sector > first_sector) {
+            extents.push_back({lba, end_sector - first_sector, cue_track.file_index, first_sector});
+            lba += end_sector - first_sector;
+        }
+
+        add_gap(lba, cue_track.postgap);
+        lba += cue_track.postgap;
+    }
+    lead_out = lba;
+}
+
+uint32_t Disk::AddFile(const std::string& path) {
+    std::error_code error;
+    uintmax_t size = std::filesystem::file_size(path, error);
+    if (error) {
+        printf("Could not open %s\n", path.c_str());
+        size = 0;
+    }
+    TrackFile file;
+    file.path = path;
+    file.sector_count = (uint32_t)(size / kSectorSize);
+    if (IsCompressed(path)) {
+        file.compressed = std::make_unique<CompressedImage>();
+        file.sector_count = file.compressed->Open(path) ? file.compressed->GetSectorCount() : 0;
+    }
+    files.push_back(std::move(file));
+    return (uint32_t)files.size() - 1;
+}
+
+const Disk::Extent* Disk::FindExtent(uint32_t lba) const {
+    auto it = std::upper_bound(extents.begin(), extents.end(), lba,
+        [](uint32_t value, const Extent& extent) { return value < extent.start_lba; });
+    if (it == extents.begin()) {
+        return nullptr;
+    }
+    --it;
+    if (lba - it->start_lba >= it->sector_count) {
+        return nullptr;
+    }
+    return &*it;
+}
+
+const uint8_t* Disk::GetFileSector(uint32_t file_index, uint32_t sector) const {
+    const TrackFile& file = files[file_index];
+    if (file.compressed) {
+        return file.compressed->ReadSector(sector);
+    }
+    // Mapped on first access, a file that fails to map stays unmapped
+    if (!file.mapping) {
+        file.mapping = std::make_unique<MappedFile>();
+        file.mapping->Open(file.path);
+    }
+    if (file.mapping->GetData() == nullptr) {
+        return nullptr;
+    }
+    return file.mapping->GetData() + (size_t)sector * kSectorSize;
+}
+
+std::span<const uint8_t> Disk::ReadSector(uint32_t lba) const {
+    const Extent* extent = FindExtent(lba);
+    if (extent == nullptr) {
+        return {};
+    }
+    if (extent->file_index == kNoFile) {
+        return std::span<const uint8_t>(kZeroSector, kSectorSize);
+    }
+    const uint8_t* data = GetFileSector(extent->file_index, extent->file_sector + (lba - extent->start_lba));
+    if (data == nullptr) {
+        return {};
+    }
+    return std::span<const uint8_t>(data, kSectorSize);
+}
+
+void Disk::Prefetch(uint32_t lba, uint32_t count) const {
+    const Extent* extent = FindExtent(lba);
+    if (extent == nullptr || extent->file_index == kNoFile) {
+        return;
+    }
+    // Only within the extent, the next file gets its own hint once reading gets there
+    count = std::min(count, extent->sector_count - (lba - extent->start_lba));
+    uint32_t sector = extent->file_sector + (lba - extent->start_lba);
+    const TrackFile& file = files[extent->file_index];
+    if (file.compressed) {
+        file.compressed->Prefetch(sector, count);
+    } else if (GetFileSector(extent->file_index, sector) != nullptr) {
+        file.mapping->Prefetch((size_t)sector * kSectorSize, (size_t)count * kSectorSize);
+    }
+}
+
+const Disk::Track* Disk::GetTrackAt(uint32_t lba) const {
+    if (lba >= lead_out) {
+        return nullptr;
+    }
+    for (auto it = tracks.rbegin(); it != tracks.rend(); ++it) {
+        if (it->start_lba <= lba) {
+            return &*it;
+        }
+    }
+    return nullptr;
+}
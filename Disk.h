@@ -1,15 +1,78 @@
 #pragma once
 
+#include <cstdint>
+#include <memory>
+#include <span>
 #include <string>
 #include <vector>
-#include <fstream>
 
+#include "CompressedImage.h"
+#include "MappedFile.h"
+
+// Disc layout built from a CUE sheet (or a single raw BIN), addressed by absolute
+// LBA where 00:02:00 is 150. Raw track files are memory mapped on first access and
+// sectors are handed out as views into the mapping, so nothing is copied. Track
+// files (or the whole image) can also be compressed .cdz images. Not thread safe,
+// the CD controller reads it through ReadAhead
 class Disk {
 public:
+    static constexpr uint32_t kSectorSize = 2352;
+    static constexpr uint32_t kLeadInSectors = 150;  // track 1 pregap, never stored in the image
+
+    struct Track {
+        uint8_t number = 0;
+        bool audio = false;
+        uint32_t start_lba = 0;     // INDEX 01
+    };
+
+    // .cue sheets, anything else (.bin or .cdz) is loaded as a single MODE2/2352 track
     void LoadGame(const std::string& path);
-    std::vector<uint8_t> read(uint32_t pos);
+    // Empty past the lead-out, zeros inside pregaps not stored in the image.
+    // Stays valid until the next LoadGame, or for compressed images until the
+    // decompression cache has cycled through
+    std::span<const uint8_t> ReadSector(uint32_t lba) const;
+    // Asks the OS to start paging in sectors that are about to be read
+    void Prefetch(uint32_t lba, uint32_t count) const;
+
+    const std::vector<Track>& GetTracks() const { return tracks; }
+    // Track containing lba, nullptr in the lead-in and lead-out
+    const Track* GetTrackAt(uint32_t lba) const;
+    uint32_t GetLeadOut() const { return lead_out; }
 private:
-    std::ifstream game_file{};
-    std::vector<uint8_t> data{};
-};
+    struct TrackFile {
+        std::string path;
+        uint32_t sector_count = 0;
+        mutable std::unique_ptr<MappedFile> mapping;
+        mutable std::unique_ptr<CompressedImage> compressed;   // .cdz, opened when added
+    };
 
+    // Contiguous run of disc sectors, either stored in a file or an unstored gap
+    struct Extent {
+        uint32_t start_lba;
+        uint32_t sector_count;
+        uint32_t file_index;        // kNoFile for gaps
+        uint32_t file_sector;
+    };
+    static constexpr uint32_t kNoFile = ~0u;
+
+    // What the CUE sheet says about a track before the layout is built
+    struct CueTrack {
+        Track track;
+        uint32_t file_index = 0;
+        uint32_t pregap = 0;        // PREGAP, not stored in the file
+        uint32_t postgap = 0;
+        int32_t index0 = -1;        // file sector of INDEX 00, -1 if there is none
+        int32_t index1 = -1;
+    };
+
+    bool ParseCue(const std::string& path, std::vector<CueTrack>& cue_tracks);
+    void BuildLayout(const std::vector<CueTrack>& cue_tracks);
+    uint32_t AddFile(const std::string& path);
+    const Extent* FindExtent(uint32_t lba) const;
+    const uint8_t* GetFileSector(uint32_t file_index, uint32_t sector) const;
+
+    std::vector<TrackFile> files;
+    std::vector<Track> tracks;
+    std::vector<Extent> extents;    // sorted by start_lba, no holes from LBA 0 to the lead-out
+    uint32_t lead_out = 0;
+};
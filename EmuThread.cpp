@@ -0,0 +1,156 @@
+#include "EmuThread.h"
+
+EmuThread::~EmuThread() {
+    Stop();
+}
+
+void EmuThread::LoadDisc(const std::string& path) {
+    system.LoadDisc(path);
+}
+
+bool EmuThread::EnableFastBoot() {
+    return system.EnableFastBoot();
+}
+
+void EmuThread::Start() {
+    if (running) {
+        return;
+    }
+    running = true;
+    audio.Start();
+    thread = std::thread(&EmuThread::Run, this);
+}
+
+void EmuThread::Stop() {
+    running = false;
+    if (thread.joinable()) {
+        thread.join();
+    }
+    audio.Stop();
+}
+
+void EmuThread::SetPacing(Pacing new_pacing) {
+    pacing = new_pacing;
+}
+
+EmuThread::Pacing EmuThread::GetPacing() const {
+    return pacing;
+}
+
+void EmuThread::SetAutoFrameSkip(bool enable) {
+    auto_frame_skip = enable;
+}
+
+bool EmuThread::GetAutoFrameSkip() const {
+    return auto_frame_skip;
+}
+
+void EmuThread::SetFieldRendering(bool enable) {
+    field_rendering = enable;
+}
+
+bool EmuThread::GetFieldRendering() const {
+    return field_rendering;
+}
+
+void EmuThread::SetGPURecording(bool enable) {
+    gpu_recording = enable;
+}
+
+bool EmuThread::GetGPURecording() const {
+    return gpu_recording;
+}
+
+void EmuThread::SetAudioRecording(bool enable) {
+    audio_recording = enable;
+}
+
+bool EmuThread::GetAudioRecording() const {
+    return audio_recording;
+}
+
+const GPU::VRAM* EmuThread::GetLatestFrame() {
+    if (!frames.Consume()) {
+        return nullptr;
+    }
+    return &frames.GetReadBuffer();
+}
+
+void EmuThread::Run() {
+    using clock = std::chrono::steady_clock;
+    auto next_frame = clock::now();
+    auto last_presented = next_frame;
+    bool skip = false;
+    int frames_skipped = 0;
+    while (running) {
+        system.SetFrameSkip(skip);
+        system.SetFieldRendering(field_rendering);
+        if (gpu_recording != gpu_recording_active) {
+            gpu_recording_active = gpu_recording;
+            if (gpu_recording_active) {
+                system.StartGPURecording(kGPUDumpPath);
+            } else {
+                system.StopGPURecording();
+            }
+        }
+        if (audio_recording != audio_recording_active) {
+            audio_recording_active = audio_recording;
+            if (audio_recording_active) {
+                audio_dump = std::make_unique<WAVFileSink>(kAudioDumpPath, AudioOutput::kSampleRate);
+            } else {
+                audio_dump.reset();
+            }
+        }
+        system.RunFrame();
+        DrainAudio();
+        if (skip) {
+            frames_skipped++;
+        } else {
+            // The presenter shows all of VRAM, not just the display area
+            system.FlushDeferredDraws();
+            frames.GetWriteBuffer() = system.GetVRAM();
+            frames.Publish();
+            last_presented = clock::now();
+            frames_skipped = 0;
+        }
+
+        Pacing curr_pacing = pacing;
+        auto now = clock::now();
+        if (curr_pacing == Pacing::FastForward) {
+            // Frames finished faster than the display can show them are not worth rendering
+            skip = auto_frame_skip && frames_skipped < kMaxFastForwardSkip
+                && now - last_presented < GetFrameDuration(Pacing::Locked);
+            next_frame = now;
+            continue;
+        }
+        auto frame_duration = GetFrameDuration(curr_pacing);
+        next_frame += frame_duration;
+        // Still late after this frame, skip rendering the next one to catch up
+        skip = auto_frame_skip && frames_skipped < kMaxFrameSkip && now > next_frame;
+        if (next_frame + kMaxFramesBehind * frame_duration < now) {
+            next_frame = now;
+        } else {
+            std::this_thread::sleep_until(next_frame);
+        }
+    }
+}
+
+void EmuThread::DrainAudio() {
+    size_t frames_read;
+    while ((frames_read = system.ReadAudio(audio_chunk, kAudioChunkFrames)) != 0) {
+        audio.Push(audio_chunk, frames_read);
+        // Straight from the SPU, the real-time output resamples, drops and repeats frames
+        if (audio_dump) {
+            audio_dump->Write((const StereoFrame*)audio_chunk, frames_read);
+        }
+    }
+}
+
+std::chrono::nanoseconds EmuThread::GetFrameDuration(Pacing curr_pacing) const {
+    int rate = system.IsPAL() ? 50 : 60;
+    std::chrono::nanoseconds duration = std::chrono::nanoseconds(1000000000 / rate);
+    if (curr_pacing == Pacing::SlowMotion) {
+        duration *= kSlowMotionFactor;
+    }
+    return duration;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "AudioOutput.h"
+#include "PSX.h"
+#include "TripleBuffer.h"
+
+// Runs the emulator on its own thread and publishes every finished frame into
+// a triple buffer, so presentation never blocks emulation and vice versa.
+class EmuThread {
+public:
+    enum class Pacing {
+        Locked,         // 60Hz (NTSC) or 50Hz (PAL), following the GPU video mode
+        FastForward,    // uncapped
+        SlowMotion      // locked rate divided by kSlowMotionFactor
+    };
+
+    ~EmuThread();
+    // Only before Start
+    void LoadDisc(const std::string& path);
+    // Only before Start, after LoadDisc
+    bool EnableFastBoot();
+    void Start();
+    void Stop();
+
+    void SetPacing(Pacing new_pacing);
+    Pacing GetPacing() const;
+    // Skip rendering frames while emulation runs behind real time (or ahead of
+    // the display in fast-forward)
+    void SetAutoFrameSkip(bool enable);
+    bool GetAutoFrameSkip() const;
+    // Only rasterize the current field in 480i modes (exact rendering by default)
+    void SetFieldRendering(bool enable);
+    bool GetFieldRendering() const;
+    // Dump the GPU command stream to kGPUDumpPath for offline replay
+    void SetGPURecording(bool enable);
+    bool GetGPURecording() const;
+    // Write the emulated 44.1kHz audio to kAudioDumpPath, sample exact at any pacing
+    void SetAudioRecording(bool enable);
+    bool GetAudioRecording() const;
+
+    // Returns the newest frame if one was published since the last call, nullptr otherwise.
+    // The pointer stays valid until the next call.
+    const GPU::VRAM* GetLatestFrame();
+private:
+    void Run();
+    void DrainAudio();
+    std::chrono::nanoseconds GetFrameDuration(Pacing curr_pacing) const;
+
+    PSX system;
+    TripleBuffer<GPU::VRAM> frames;
+    AudioOutput audio;
+    std::thread thread;
+    std::atomic<bool> running = false;
+    std::atomic<Pacing> pacing = Pacing::Locked;
+    std::atomic<bool> auto_frame_skip = false;
+    std::atomic<bool> field_rendering = false;
+    std::atomic<bool> gpu_recording = false;
+    bool gpu_recording_active = false;  // owned by the emulation thread
+    std::atomic<bool> audio_recording = false;
+    bool audio_recording_active = false;    // owned by the emulation thread
+    std::unique_ptr<WAVFileSink> audio_dump{};  // owned by the emulation thread
+
+    static const size_t kAudioChunkFrames = 1024;
+    const char* kGPUDumpPath = "gpu_dump.bin";
+    const char* kAudioDumpPath = "audio.wav";
+    const int kSlowMotionFactor = 2;
+    const int kMaxFramesBehind = 4;     // resync instead of running ahead after a long stall
+    const int kMaxFrameSkip = 3;        // consecutive skipped frames when running behind
+    const int kMaxFastForwardSkip = 9;  // consecutive skipped frames in fast-forward
+
+    int16_t audio_chunk[kAudioChunkFrames * 2];
+};
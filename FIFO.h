@@ -0,0 +1,38 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+// Fixed capacity queue for the small hardware FIFOs, never allocates. Pushing
+// into a full FIFO drops the value like the hardware does.
+template <typename T, size_t N>
+class FIFO {
+public:
+    bool Push(T value) {
+        if (count == N) {
+            return false;
+        }
+        values[(head + count) % N] = value;
+        count++;
+        return true;
+    }
+    // Front and Pop need a non-empty FIFO
+    T Front() const { return values[head]; }
+    T Pop() {
+        T value = values[head];
+        head = (head + 1) % N;
+        count--;
+        return value;
+    }
+    void Clear() {
+        head = 0;
+        count = 0;
+    }
+    bool Empty() const { return count == 0; }
+    bool Full() const { return count == N; }
+    size_t Size() const { return count; }
+private:
+    std::array<T, N> values{};
+    size_t head = 0;
+    size_t count = 0;
+};
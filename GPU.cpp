@@ -1,10 +1,13 @@
 #include "GPU.h"
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image_write.h>
 #include <vector>
 
+#define GPU_LOG 0
+
 void GPU::Init(IRQ* irq) {
     vram.fill(0);
     this->irq = irq;
@@ -23,6 +26,7 @@ bool GPU::Cycle(int cycles) {
     if (gpu_lines < 242) {
         if (GPUSTAT.vert_res && GPUSTAT.vert_interlace) {
             GPUSTAT.draw_even_odd_lines = (frames % 2) != 0;
+            field_parity = GPUSTAT.draw_even_odd_lines;
         } else {
             GPUSTAT.draw_even_odd_lines = (gpu_lines % 2) != 0;
         }
@@ -34,6 +38,11 @@ bool GPU::Cycle(int cycles) {
     if (gpu_lines == 262) {
         gpu_lines = 0;
         frames++;
+        if (recorder) {
+            recorder->WriteFrame();
+        } else if (!recording_path.empty() && curr_cmd == CommandType::Other) {
+            BeginRecording();
+        }
         irq->TriggerIRQ(0);
         return true;
     }
@@ -60,6 +69,61 @@ uint32_t GPU::Read32(uint32_t offset) {
     }
 }
 
+int GPU::GetFieldLineParity() const {
+    if (!field_rendering || !GPUSTAT.vert_res || !GPUSTAT.vert_interlace) {
+        return -1;
+    }
+    // Only when the game draws full 480 line frames into the displayed area, anything
+    // drawn per field or off-screen (e.g. textures) is rasterized in full
+    if (drawing_area_bottom < drawing_area_top + 256
+        || drawing_area_bottom < disp_start_y || drawing_area_top >= disp_start_y + 480) {
+        return -1;
+    }
+    return field_parity;
+}
+
+void GPU::StartRecording(const std::string& path) {
+    StopRecording();
+    recording_path = path;
+}
+
+void GPU::StopRecording() {
+    if (recorder) {
+        recorder->Close();
+        recorder.reset();
+    }
+    recording_path.clear();
+}
+
+void GPU::BeginRecording() {
+    // The dump starts from the VRAM a live run would show, draws of skipped frames included
+    FlushDeferredDraws();
+    recorder = std::make_unique<GPUDumpWriter>();
+    if (!recorder->Open(recording_path, vram.data(), vram.size())) {
+        printf("Could not open GPU dump file %s\n", recording_path.c_str());
+        recorder.reset();
+        recording_path.clear();
+        return;
+    }
+    recording_path.clear();
+
+    // Replay the current display and drawing state so the dump is self contained
+    uint32_t display_mode = GPUSTAT.horiz_res_1 | (GPUSTAT.vert_res << 2)
+        | (GPUSTAT.video_mode << 3) | (GPUSTAT.disp_area_depth << 4)
+        | (GPUSTAT.vert_interlace << 5) | (GPUSTAT.horiz_res_2 << 6)
+        | (GPUSTAT.reverse_flag << 7);
+    recorder->WriteGP1(0x08000000 | display_mode);
+    recorder->WriteGP1(0x05000000 | disp_start_x | (disp_start_y << 10));
+    recorder->WriteGP1(0x06000000 | horiz_disp_x1 | (horiz_disp_x2 << 12));
+    recorder->WriteGP1(0x07000000 | vert_disp_y1 | (vert_disp_y2 << 10));
+    recorder->WriteGP0(0xE1000000 | (draw_mode.reg & 0x00FFFFFF));
+    recorder->WriteGP0(0xE2000000 | (tex_window_settings.reg & 0x00FFFFFF));
+    recorder->WriteGP0(0xE3000000 | drawing_area_left | (drawing_area_top << 10));
+    recorder->WriteGP0(0xE4000000 | drawing_area_right | (drawing_area_bottom << 10));
+    recorder->WriteGP0(0xE5000000 | (x_offset & 0x7FF) | ((y_offset & 0x7FF) << 11));
+    recorder->WriteGP0(0xE6000000 | GPUSTAT.set_mask_bit | (GPUSTAT.draw_pixels << 1));
+}
+
 void GPU::GetGPUInfo() {
     if (read_index == 2) {
         read_data = tex_window_settings.reg;
@@ -98,11 +162,15 @@ void GPU::DumpVRAM() {
 void GPU::Write32(uint32_t offset, uint32_t data) {
     switch (offset) {
     case 0:
+#if GPU_LOG
         printf("GP0 Command (CPU): %08x\n", data);
+#endif // GPU_LOG
         GP0Command(data);
         break;
     case 4:
+#if GPU_LOG
         printf("GP1 Command (CPU): %08x\n", data);
+#endif // GPU_LOG
         GP1Command(data);
         break;
     default:
@@ -112,9 +180,20 @@ void GPU::Write32(uint32_t offset, uint32_t data) {
     }
 }
 
+void GPU::GP0Commands(const uint32_t* commands, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        GP0Command(commands[i]);
+    }
+}
+
 void GPU::GP0Command(uint32_t command) {
     uint32_t opcode = command >> 24;
+#if GPU_LOG
     printf("GP0 Command: %08x\n", command);
+#endif // GPU_LOG
+    if (recorder) {
+        recorder->WriteGP0(command);
+    }
     if (curr_cmd == CommandType::Other) {
         command_fifo.clear();
         command_fifo.push_back(command);
@@ -174,13 +253,13 @@ void GPU::GP0Command(uint32_t command) {
         //printf("Drawing Polygon (%02x)\n", command_fifo[0] >> 24);
         uint8_t opcode = command_fifo[0] >> 24;
         std::vector<uint32_t> commands(command_fifo.begin(), command_fifo.end());
-        renderer.DrawPolygon(commands);
+        SubmitDraw(CommandType::DrawPolygon, commands);
         curr_cmd = CommandType::Other;
     } else if (curr_cmd == CommandType::DrawRect) {
         //printf("Drawing Rectangle (%02x)\n", command_fifo[0] >> 24);
         uint8_t opcode = command_fifo[0] >> 24;
         std::vector<uint32_t> commands(command_fifo.begin(), command_fifo.end());
-        renderer.DrawRect(commands);
+        SubmitDraw(CommandType::DrawRect, commands);
         curr_cmd = CommandType::Other;
     } else if (curr_cmd == CommandType::CopyRectangle) {
         uint32_t coords = command_fifo[1];
@@ -193,16 +272,22 @@ void GPU::GP0Command(uint32_t command) {
         transfer_width = ((transfer_width - 1) & 0x3FFu) + 1;
         transfer_height = (size >> 16) & 0xFFFFu;
         transfer_height = ((transfer_height - 1) & 0x1FFu) + 1;
+        FlushDeferredDrawsIfOverlapping(transfer_start_x, transfer_start_y, transfer_width,
+            transfer_height, copy_dir == CopyDirection::CPUtoVRAM);
         size = transfer_width * transfer_height;
         if (size % 2 == 1) {
             size++;
         }
         if (copy_dir == CopyDirection::CPUtoVRAM) {
+#if GPU_LOG
             printf("Copying Rectangle from CPU to VRAM\n");
+#endif // GPU_LOG
             commands_left = size / 2;
             curr_cmd = CommandType::TransferringCPUtoVRAM;
         } else if (copy_dir == CopyDirection::VRAMtoCPU) {
+#if GPU_LOG
             printf("Copying Rectangle from VRAM to CPU\n");
+#endif // GPU_LOG
             curr_cmd = CommandType::Other;
             read_mode = GPUREADMode::GPUInfo;
         } else {
@@ -221,6 +306,9 @@ void GPU::GP0Command(uint32_t command) {
 
 void GPU::GP1Command(uint32_t command) {
     uint32_t opcode = command >> 24;
+    if (recorder) {
+        recorder->WriteGP1(command);
+    }
     switch (opcode) {
         case 0x00:
             ResetGPU();
@@ -271,6 +359,8 @@ void GPU::FillRectInVRAM() {
     uint32_t height = command_fifo[2] >> 16;
     width = ((width & 0x3FF) + 0x0F) & (~0x0F);
     height &= 0x1FF;
+    DiscardOverwrittenDraws(x, y, width, height);
+    FlushDeferredDrawsIfOverlapping(x, y, width, height, true);
     for (uint32_t i = x; i < x + width; i++) {
         for (uint32_t j = y; j < y + height; j++) {
             SetVRAMFromPos(i, j, color.raw);
@@ -415,4 +505,187 @@ void GPU::MoveVRAMTransferPosition() {
     else {
         curr_transfer_x++;
     }
-}
\ No newline at end of file
+}
+
+void GPU::SubmitDraw(CommandType type, const std::vector<uint32_t>& commands) {
+    if (!skip_frame && deferred_draws.empty()) {
+        RenderDraw(type, commands);
+        return;
+    }
+
+    // Texture and CLUT fetches must see every deferred draw that came before
+    TileMask tex_regions;
+    bool textured = GetTextureRegions(type, commands, tex_regions);
+    if (textured && (tex_regions & deferred_writes).any()) {
+        FlushDeferredDraws();
+    }
+
+    uint32_t area_width = drawing_area_right - drawing_area_left + 1;
+    uint32_t area_height = drawing_area_bottom - drawing_area_top + 1;
+    TileMask area = GetTiles(drawing_area_left, drawing_area_top, area_width, area_height);
+    if (skip_frame && IsFramebufferDrawingArea()) {
+        deferred_writes |= area;
+        deferred_reads |= tex_regions;
+        deferred_draws.push_back({type, commands, x_offset, y_offset,
+            drawing_area_top, drawing_area_bottom, drawing_area_left, drawing_area_right,
+            tex_window_settings, draw_mode, (bool)GPUSTAT.set_mask_bit, (bool)GPUSTAT.draw_pixels,
+            area, tex_regions});
+        if (deferred_draws.size() >= kMaxDeferredDraws) {
+            FlushDeferredDraws();
+        }
+        return;
+    }
+
+    // Keep the ordering with deferred draws that touch the same VRAM
+    if ((area & (deferred_writes | deferred_reads)).any()) {
+        FlushDeferredDraws();
+    }
+    RenderDraw(type, commands);
+}
+
+void GPU::RenderDraw(CommandType type, const std::vector<uint32_t>& commands) {
+    if (type == CommandType::DrawPolygon) {
+        renderer.DrawPolygon(commands);
+    } else if (type == CommandType::DrawRect) {
+        renderer.DrawRect(commands);
+    }
+}
+
+bool GPU::IsFramebufferDrawingArea() const {
+    const uint32_t horiz_res[4] = {256, 320, 512, 640};
+    uint32_t disp_width = GPUSTAT.horiz_res_2 ? 368 : horiz_res[GPUSTAT.horiz_res_1];
+    uint32_t disp_height = (GPUSTAT.vert_res && GPUSTAT.vert_interlace) ? 480 : 240;
+    return drawing_area_right >= drawing_area_left + disp_width - 1
+        && drawing_area_bottom >= drawing_area_top + disp_height - 1;
+}
+
+bool GPU::GetTextureRegions(CommandType type, const std::vector<uint32_t>& commands,
+    TileMask& regions) const {
+    uint8_t opcode = commands[0] >> 24;
+    DrawMode page = draw_mode;
+    if (type == CommandType::DrawPolygon) {
+        PolygonArgs args{opcode};
+        if (!args.textured) {
+            return false;
+        }
+        page.reg = commands[4 + args.shaded] >> 16;
+    } else {
+        RectangleArgs args{opcode};
+        if (!args.textured) {
+            return false;
+        }
+    }
+    Palette palette = Palette::FromCommand(commands[2]);
+    uint32_t page_width = 256;
+    if (page.tex_page_colors == TextureDepth::FourBits) {
+        page_width = 64;
+        regions |= GetTiles(palette.x * 16, palette.y, 16, 1);
+    } else if (page.tex_page_colors == TextureDepth::EightBits) {
+        page_width = 128;
+        regions |= GetTiles(palette.x * 16, palette.y, 256, 1);
+    }
+    regions |= GetTiles(page.tex_page_x_base * 64, page.tex_page_y_base * 256, page_width, 256);
+    return true;
+}
+
+void GPU::FlushDeferredDraws() {
+    int16_t curr_x_offset = x_offset;
+    int16_t curr_y_offset = y_offset;
+    uint32_t curr_area_top = drawing_area_top;
+    uint32_t curr_area_bottom = drawing_area_bottom;
+    uint32_t curr_area_left = drawing_area_left;
+    uint32_t curr_area_right = drawing_area_right;
+    TextureWindowSetting curr_tex_window = tex_window_settings;
+    DrawMode curr_draw_mode = draw_mode;
+    uint32_t curr_set_mask_bit = GPUSTAT.set_mask_bit;
+    uint32_t curr_draw_pixels = GPUSTAT.draw_pixels;
+
+    for (const DeferredDraw& draw : deferred_draws) {
+        x_offset = draw.x_offset;
+        y_offset = draw.y_offset;
+        drawing_area_top = draw.drawing_area_top;
+        drawing_area_bottom = draw.drawing_area_bottom;
+        drawing_area_left = draw.drawing_area_left;
+        drawing_area_right = draw.drawing_area_right;
+        tex_window_settings = draw.tex_window_settings;
+        draw_mode = draw.draw_mode;
+        GPUSTAT.set_mask_bit = draw.set_mask_bit;
+        GPUSTAT.draw_pixels = draw.draw_pixels;
+        RenderDraw(draw.type, draw.commands);
+    }
+    deferred_draws.clear();
+    deferred_writes.reset();
+    deferred_reads.reset();
+
+    x_offset = curr_x_offset;
+    y_offset = curr_y_offset;
+    drawing_area_top = curr_area_top;
+    drawing_area_bottom = curr_area_bottom;
+    drawing_area_left = curr_area_left;
+    drawing_area_right = curr_area_right;
+    tex_window_settings = curr_tex_window;
+    draw_mode = curr_draw_mode;
+    GPUSTAT.set_mask_bit = curr_set_mask_bit;
+    GPUSTAT.draw_pixels = curr_draw_pixels;
+}
+
+void GPU::FlushDeferredDrawsIfOverlapping(uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+    bool check_reads) {
+    if (deferred_draws.empty()) {
+        return;
+    }
+    TileMask region = GetTiles(x, y, width, height);
+    if ((region & deferred_writes).any() || (check_reads && (region & deferred_reads).any())) {
+        FlushDeferredDraws();
+    }
+}
+
+// Deferred draws that only touched tiles the fill covers completely can never be observed
+void GPU::DiscardOverwrittenDraws(uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+    if (deferred_draws.empty()) {
+        return;
+    }
+    TileMask covered = GetCoveredTiles(x, y, width, height);
+    if (covered.none()) {
+        return;
+    }
+    auto overwritten = [&covered](const DeferredDraw& draw) { return (draw.area & ~covered).none(); };
+    deferred_draws.erase(std::remove_if(deferred_draws.begin(), deferred_draws.end(), overwritten),
+        deferred_draws.end());
+    // Rebuild the masks from what's left, textures of dropped draws don't matter any more
+    deferred_writes.reset();
+    deferred_reads.reset();
+    for (const DeferredDraw& draw : deferred_draws) {
+        deferred_writes |= draw.area;
+        deferred_reads |= draw.tex_regions;
+    }
+}
+
+GPU::TileMask GPU::GetTiles(uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+    TileMask tiles;
+    if (width == 0 || height == 0 || x >= VRAM_WIDTH || y >= VRAM_HEIGHT) {
+        return tiles;
+    }
+    const uint32_t tiles_per_row = VRAM_WIDTH / kTileSize;
+    uint32_t last_x = std::min(x + width - 1, (uint32_t)VRAM_WIDTH - 1) / kTileSize;
+    uint32_t last_y = std::min(y + height - 1, (uint32_t)VRAM_HEIGHT - 1) / kTileSize;
+    for (uint32_t tile_y = y / kTileSize; tile_y <= last_y; tile_y++) {
+        for (uint32_t tile_x = x / kTileSize; tile_x <= last_x; tile_x++) {
+            tiles.set(tile_y * tiles_per_row + tile_x);
+        }
+    }
+    return tiles;
+}
+
+// Only the tiles completely inside the rectangle
+GPU::TileMask GPU::GetCoveredTiles(uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+    uint32_t first_x = (x + kTileSize - 1) / kTileSize;
+    uint32_t first_y = (y + kTileSize - 1) / kTileSize;
+    uint32_t end_x = std::min(x + width, (uint32_t)VRAM_WIDTH) / kTileSize;
+    uint32_t end_y = std::min(y + height, (uint32_t)VRAM_HEIGHT) / kTileSize;
+    if (first_x >= end_x || first_y >= end_y) {
+        return TileMask();
+    }
+    return GetTiles(first_x * kTileSize, first_y * kTileSize, (end_x - first_x) * kTileSize,
+        (end_y - first_y) * kTileSize);
+}
@@ -3,9 +3,14 @@
 #include <cstdint>
 #include <deque>
 #include <array>
+#include <bitset>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include "IRQ.h"
 #include "GPUCommands.h"
+#include "GPUDump.h"
 #include "Renderer.h"
 
 #define VRAM_WIDTH      1024
@@ -20,6 +25,7 @@ public:
     void Write32(uint32_t offset, uint32_t data);
 
     void GP0Command(uint32_t command);
+    void GP0Commands(const uint32_t* commands, uint32_t count);
     void GP1Command(uint32_t command);
 
     void DumpVRAM();
@@ -31,6 +37,17 @@ public:
     void SetVRAMFromPos(uint16_t x, uint16_t y, uint16_t data);
     const TextureWindowSetting& GetTexWindowSetting() const {return tex_window_settings;};
     const DrawMode& GetDrawMode() const {return draw_mode;}
+    bool IsPAL() const { return GPUSTAT.video_mode; }
+    void SetFrameSkip(bool skip) { skip_frame = skip; }
+    // Rasterizes the draws deferred by frame skipping, VRAM is complete afterwards
+    void FlushDeferredDraws();
+    void SetFieldRendering(bool enable) { field_rendering = enable; }
+    int GetFieldLineParity() const;
+
+    // Records every GP0/GP1 word to a dump file, starting at the next vblank
+    void StartRecording(const std::string& path);
+    void StopRecording();
+    bool IsRecording() const { return recorder != nullptr || !recording_path.empty(); }
 
     int16_t x_offset = 0;               // -1024...1023
     int16_t y_offset = 0;               // -1024...1023
@@ -48,6 +65,14 @@ private:
     int gpu_dot = 0;
     int gpu_lines = 0;
 
+    // Opt-in: in 480i modes only rasterize the lines of the current field
+    bool field_rendering = false;
+    uint32_t field_parity = 0;          // draw_even_odd_lines of the last displayed line
+
+    std::unique_ptr<GPUDumpWriter> recorder{};
+    std::string recording_path{};       // set while waiting for vblank to start recording
+    void BeginRecording();
+
     VRAM vram{};
     void MoveVRAMTransferPosition();
     DrawMode draw_mode{};
@@ -59,6 +84,47 @@ private:
 
     int GetArgCount(uint8_t opcode) const;
 
+    // Frame skipping: on skipped frames draws into a framebuffer sized drawing area are
+    // deferred instead of rasterized. VRAM is tracked in tiles, and anything that could
+    // observe a deferred draw (texture reads, transfers, fills, other draws) replays the
+    // deferred list first. The list carries over vblank, draws are only dropped once a
+    // fill has overwritten every tile they could have touched.
+    static constexpr int kTileSize = 32;
+    using TileMask = std::bitset<(VRAM_WIDTH / kTileSize) * (VRAM_HEIGHT / kTileSize)>;
+    struct DeferredDraw {
+        CommandType type;
+        std::vector<uint32_t> commands;
+        int16_t x_offset;
+        int16_t y_offset;
+        uint32_t drawing_area_top;
+        uint32_t drawing_area_bottom;
+        uint32_t drawing_area_left;
+        uint32_t drawing_area_right;
+        TextureWindowSetting tex_window_settings;
+        DrawMode draw_mode;
+        bool set_mask_bit;      // GP0 E6h at the time of the draw
+        bool draw_pixels;
+        TileMask area;          // tiles of the drawing area, everything the draw could write
+        TileMask tex_regions;   // texture page and CLUT tiles it reads
+    };
+    static constexpr size_t kMaxDeferredDraws = 16384;  // flushed past this, nothing overwrote them
+
+    bool skip_frame = false;
+    std::vector<DeferredDraw> deferred_draws{};
+    TileMask deferred_writes{};
+    TileMask deferred_reads{};
+
+    void SubmitDraw(CommandType type, const std::vector<uint32_t>& commands);
+    void RenderDraw(CommandType type, const std::vector<uint32_t>& commands);
+    bool IsFramebufferDrawingArea() const;
+    bool GetTextureRegions(CommandType type, const std::vector<uint32_t>& commands,
+        TileMask& regions) const;
+    void FlushDeferredDrawsIfOverlapping(uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+        bool check_reads);
+    void DiscardOverwrittenDraws(uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+    static TileMask GetTiles(uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+    static TileMask GetCoveredTiles(uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+
     // GP0 commands
     void FillRectInVRAM();
     void DrawModeSetting(uint32_t command);
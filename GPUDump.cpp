@@ -0,0 +1,92 @@
+#include "GPUDump.h"
+
+#include <cstring>
+
+static const char kMagic[8] = {'P', 'S', 'X', 'G', 'P', 'U', 'D', 'P'};
+static const uint32_t kVersion = 1;
+
+bool GPUDumpWriter::Open(const std::string& path, const uint16_t* vram, size_t vram_size) {
+    file.open(path, std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+    file.write(kMagic, sizeof(kMagic));
+    file.write((const char*)&kVersion, sizeof(kVersion));
+    file.write((const char*)vram, vram_size * sizeof(uint16_t));
+    return true;
+}
+
+void GPUDumpWriter::Close() {
+    if (!file.is_open()) {
+        return;
+    }
+    FlushGP0();
+    file.close();
+}
+
+void GPUDumpWriter::WriteGP0(uint32_t word) {
+    gp0_words.push_back(word);
+}
+
+void GPUDumpWriter::WriteGP1(uint32_t word) {
+    FlushGP0();
+    GPUDumpRecord::Type type = GPUDumpRecord::Type::GP1;
+    file.write((const char*)&type, sizeof(type));
+    file.write((const char*)&word, sizeof(word));
+}
+
+void GPUDumpWriter::WriteFrame() {
+    FlushGP0();
+    GPUDumpRecord::Type type = GPUDumpRecord::Type::Frame;
+    file.write((const char*)&type, sizeof(type));
+}
+
+void GPUDumpWriter::FlushGP0() {
+    if (gp0_words.empty()) {
+        return;
+    }
+    GPUDumpRecord::Type type = GPUDumpRecord::Type::GP0;
+    uint32_t count = (uint32_t)gp0_words.size();
+    file.write((const char*)&type, sizeof(type));
+    file.write((const char*)&count, sizeof(count));
+    file.write((const char*)gp0_words.data(), count * sizeof(uint32_t));
+    gp0_words.clear();
+}
+
+bool GPUDumpReader::Open(const std::string& path, uint16_t* vram, size_t vram_size) {
+    file.open(path, std::ios::binary | std::ios::in);
+    if (!file.is_open()) {
+        return false;
+    }
+    char magic[sizeof(kMagic)];
+    uint32_t version = 0;
+    file.read(magic, sizeof(magic));
+    file.read((char*)&version, sizeof(version));
+    if (!file || memcmp(magic, kMagic, sizeof(kMagic)) != 0 || version != kVersion) {
+        return false;
+    }
+    file.read((char*)vram, vram_size * sizeof(uint16_t));
+    return (bool)file;
+}
+
+bool GPUDumpReader::ReadRecord(GPUDumpRecord& record) {
+    if (!file.read((char*)&record.type, sizeof(record.type))) {
+        return false;
+    }
+    uint32_t count = 0;
+    switch (record.type) {
+        case GPUDumpRecord::Type::GP0:
+            file.read((char*)&count, sizeof(count));
+            break;
+        case GPUDumpRecord::Type::GP1:
+            count = 1;
+            break;
+        case GPUDumpRecord::Type::Frame:
+            break;
+        default:
+            return false;
+    }
+    record.words.resize(count);
+    file.read((char*)record.words.data(), count * sizeof(uint32_t));
+    return (bool)file;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Binary GPU command stream dump:
+//   header:  "PSXGPUDP", uint32 version, VRAM snapshot (1024 * 512 halfwords)
+//   records: uint8 type, followed by
+//            GP0   -> uint32 word count, words
+//            GP1   -> uint32 word
+//            Frame -> nothing (vblank)
+// Consecutive GP0 words are batched into a single record.
+struct GPUDumpRecord {
+    enum class Type : uint8_t {
+        GP0 = 0,
+        GP1 = 1,
+        Frame = 2
+    } type;
+    std::vector<uint32_t> words;    // empty for Frame
+};
+
+class GPUDumpWriter {
+public:
+    ~GPUDumpWriter() { Close(); }
+    bool Open(const std::string& path, const uint16_t* vram, size_t vram_size);
+    void Close();
+    bool IsOpen() const { return file.is_open(); }
+
+    void WriteGP0(uint32_t word);
+    void WriteGP1(uint32_t word);
+    void WriteFrame();
+private:
+    void FlushGP0();
+
+    std::ofstream file{};
+    std::vector<uint32_t> gp0_words{};
+};
+
+class GPUDumpReader {
+public:
+    bool Open(const std::string& path, uint16_t* vram, size_t vram_size);
+    // Returns false at the end of the dump
+    bool ReadRecord(GPUDumpRecord& record);
+private:
+    std::ifstream file{};
+};
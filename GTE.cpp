@@ -2,7 +2,161 @@
 #include <algorithm>
 #include <cassert>
 
-GTE::GTE() : UNR_table(GenerateUNRTable()) {}
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Vectorized matrix kernels, selected at compile time (/arch:AVX2 or -mavx2/-msse4.1)
+#if defined(__AVX2__)
+#define GTE_AVX2 1
+#include <immintrin.h>
+#elif defined(__SSE4_1__) || defined(__AVX__)
+#define GTE_SSE41 1
+#include <smmintrin.h>
+#endif
+
+// Plain-array view of a transform, shared by the scalar and vector kernels
+struct TransformArgs {
+    int32_t m[3][3];        // [row][column]
+    int32_t v[4][3];        // [vector][x, y, z], fourth vector is padding
+    int64_t tr[3];          // already shifted left by 12
+    int count;
+    bool sf;
+    int32_t ir_min;         // 0 with lm set, -0x8000 otherwise
+};
+
+static const uint32_t kMacOverflowPos[3] = {1 << 30, 1 << 29, 1 << 28};
+static const uint32_t kMacOverflowNeg[3] = {1 << 27, 1 << 26, 1 << 25};
+static const uint32_t kIrSaturated[3] = {1 << 24, 1 << 23, 1 << 22};
+
+#if GTE_AVX2
+// Every 64 bit lane holds one vector, rows are computed one after the other
+static uint32_t TransformKernel(const TransformArgs& args, int32_t mac[3][3], int16_t ir[3][3]) {
+    uint32_t flags = 0;
+    const __m256i x = _mm256_setr_epi64x(args.v[0][0], args.v[1][0], args.v[2][0], args.v[3][0]);
+    const __m256i y = _mm256_setr_epi64x(args.v[0][1], args.v[1][1], args.v[2][1], args.v[3][1]);
+    const __m256i z = _mm256_setr_epi64x(args.v[0][2], args.v[1][2], args.v[2][2], args.v[3][2]);
+    const __m256i bias = _mm256_set1_epi64x(1LL << 43);
+    const __m256i low_dwords = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+    const int lane_mask = (1 << args.count) - 1;
+    for (int row = 0; row < 3; row++) {
+        __m256i acc = _mm256_set1_epi64x(args.tr[row]);
+        acc = _mm256_add_epi64(acc, _mm256_mul_epi32(_mm256_set1_epi64x(args.m[row][0]), x));
+        acc = _mm256_add_epi64(acc, _mm256_mul_epi32(_mm256_set1_epi64x(args.m[row][1]), y));
+        acc = _mm256_add_epi64(acc, _mm256_mul_epi32(_mm256_set1_epi64x(args.m[row][2]), z));
+
+        // Outside of 44 bits exactly when the biased value has bits above bit 43
+        __m256i outside = _mm256_srli_epi64(_mm256_add_epi64(acc, bias), 44);
+        __m256i inside = _mm256_cmpeq_epi64(outside, _mm256_setzero_si256());
+        int overflow = ~_mm256_movemask_pd(_mm256_castsi256_pd(inside)) & lane_mask;
+        int negative = _mm256_movemask_pd(_mm256_castsi256_pd(acc));
+        if (overflow & ~negative) {
+            flags |= kMacOverflowPos[row];
+        }
+        if (overflow & negative) {
+            flags |= kMacOverflowNeg[row];
+        }
+
+        // The low dword of a logical shift matches the arithmetic one
+        if (args.sf) {
+            acc = _mm256_srli_epi64(acc, 12);
+        }
+        __m128i macs = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(acc, low_dwords));
+        __m128i max = _mm_set1_epi32(0x7FFF);
+        __m128i min = _mm_set1_epi32(args.ir_min);
+        __m128i sat = _mm_or_si128(_mm_cmpgt_epi32(macs, max), _mm_cmplt_epi32(macs, min));
+        if (_mm_movemask_ps(_mm_castsi128_ps(sat)) & lane_mask) {
+            flags |= kIrSaturated[row];
+        }
+        alignas(16) int32_t lanes[4];
+        alignas(16) int32_t clamped[4];
+        _mm_store_si128((__m128i*)lanes, macs);
+        _mm_store_si128((__m128i*)clamped, _mm_min_epi32(_mm_max_epi32(macs, min), max));
+        for (int i = 0; i < args.count; i++) {
+            mac[i][row] = lanes[i];
+            ir[i][row] = (int16_t)clamped[i];
+        }
+    }
+    return flags;
+}
+#elif GTE_SSE41
+// Same as the AVX2 kernel on two vectors at a time, SSE4.1 has no 64 bit compare
+static uint32_t TransformKernel(const TransformArgs& args, int32_t mac[3][3], int16_t ir[3][3]) {
+    uint32_t flags = 0;
+    const __m128i bias = _mm_set1_epi64x(1LL << 43);
+    for (int first = 0; first < args.count; first += 2) {
+        const int32_t* v0 = args.v[first];
+        const int32_t* v1 = args.v[first + 1];
+        const __m128i x = _mm_set_epi64x(v1[0], v0[0]);
+        const __m128i y = _mm_set_epi64x(v1[1], v0[1]);
+        const __m128i z = _mm_set_epi64x(v1[2], v0[2]);
+        const int lane_mask = args.count - first >= 2 ? 0x3 : 0x1;
+        for (int row = 0; row < 3; row++) {
+            __m128i acc = _mm_set1_epi64x(args.tr[row]);
+            acc = _mm_add_epi64(acc, _mm_mul_epi32(_mm_set1_epi64x(args.m[row][0]), x));
+            acc = _mm_add_epi64(acc, _mm_mul_epi32(_mm_set1_epi64x(args.m[row][1]), y));
+            acc = _mm_add_epi64(acc, _mm_mul_epi32(_mm_set1_epi64x(args.m[row][2]), z));
+
+            __m128i outside = _mm_srli_epi64(_mm_add_epi64(acc, bias), 44);
+            __m128i inside = _mm_cmpeq_epi64(outside, _mm_setzero_si128());
+            int overflow = ~_mm_movemask_pd(_mm_castsi128_pd(inside)) & lane_mask;
+            int negative = _mm_movemask_pd(_mm_castsi128_pd(acc));
+            if (overflow & ~negative) {
+                flags |= kMacOverflowPos[row];
+            }
+            if (overflow & negative) {
+                flags |= kMacOverflowNeg[row];
+            }
+
+            if (args.sf) {
+                acc = _mm_srli_epi64(acc, 12);
+            }
+            __m128i macs = _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 0, 2, 0));
+            __m128i max = _mm_set1_epi32(0x7FFF);
+            __m128i min = _mm_set1_epi32(args.ir_min);
+            __m128i sat = _mm_or_si128(_mm_cmpgt_epi32(macs, max), _mm_cmplt_epi32(macs, min));
+            if (_mm_movemask_ps(_mm_castsi128_ps(sat)) & lane_mask) {
+                flags |= kIrSaturated[row];
+            }
+            alignas(16) int32_t lanes[4];
+            alignas(16) int32_t clamped[4];
+            _mm_store_si128((__m128i*)lanes, macs);
+            _mm_store_si128((__m128i*)clamped, _mm_min_epi32(_mm_max_epi32(macs, min), max));
+            for (int i = 0; i < 2 && first + i < args.count; i++) {
+                mac[first + i][row] = lanes[i];
+                ir[first + i][row] = (int16_t)clamped[i];
+            }
+        }
+    }
+    return flags;
+}
+#else
+static uint32_t TransformKernel(const TransformArgs& args, int32_t mac[3][3], int16_t ir[3][3]) {
+    uint32_t flags = 0;
+    for (int i = 0; i < args.count; i++) {
+        for (int row = 0; row < 3; row++) {
+            int64_t acc = args.tr[row] + (int64_t)args.m[row][0] * args.v[i][0]
+                + (int64_t)args.m[row][1] * args.v[i][1] + (int64_t)args.m[row][2] * args.v[i][2];
+            if (acc >= (1LL << 43)) {
+                flags |= kMacOverflowPos[row];
+            }
+            if (acc < -(1LL << 43)) {
+                flags |= kMacOverflowNeg[row];
+            }
+            if (args.sf) {
+                acc >>= 12;
+            }
+            int32_t value = (int32_t)acc;
+            mac[i][row] = value;
+            if (value > 0x7FFF || value < args.ir_min) {
+                flags |= kIrSaturated[row];
+            }
+            ir[i][row] = (int16_t)std::clamp(value, args.ir_min, 0x7FFF);
+        }
+    }
+    return flags;
+}
+#endif
 
 uint32_t GetLeadingBitCount(uint32_t num) {
     if (num & 0x80000000) {
@@ -36,30 +190,30 @@ uint32_t GetLeadingBitCount(uint32_t num) {
     return n - num;
 }
 
-uint16_t GetLeadingZeroes(uint16_t num) {
-    unsigned y = num >> 8;
-    int n = 16;
-    if (y != 0) {
-        n -= 8;
-        num = y;
-    }
-    y = num >> 4;
-    if (y != 0) {
-        n -= 4;
-        num = y;
-    }
-    y = num >> 2;
-    if (y != 0) {
-        n -= 2;
-        num = y;
-    }
-    y = num >> 1;
-    if (y != 0) {
-        return n - 2;
+// Leading zeroes of a non-zero 16 bit value
+static uint32_t GetLeadingZeroes(uint16_t num) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse(&index, num);
+    return 15 - index;
+#else
+    return __builtin_clz(num) - 16;
+#endif
+}
+
+// Initial reciprocal guesses for the divide, indexed by the top bits of the normalized divisor
+static constexpr std::array<uint8_t, 0x101> GenerateUNRTable() {
+    std::array<uint8_t, 0x101> table{};
+    for (int i = 0; i < (int)table.size(); i++) {
+        table[i] = (uint8_t)std::max(0, (0x40000 / (i + 0x100) + 1) / 2 - 0x101);
     }
-    return n - num;
+    return table;
 }
 
+static constexpr std::array<uint8_t, 0x101> kUNRTable = GenerateUNRTable();
+static_assert(kUNRTable[0x00] == 0xFF && kUNRTable[0x01] == 0xFD && kUNRTable[0x0F] == 0xE3);
+static_assert(kUNRTable[0xFF] == 0x00 && kUNRTable[0x100] == 0x00);
+
 uint32_t GTE::Read(uint32_t reg_num) {
     switch (reg_num) {
         case 0: return (v[0].y << 16) | v[0].x;
@@ -128,7 +282,11 @@ uint32_t GTE::Read(uint32_t reg_num) {
         case 60: return dqb;
         case 61: return zsf3;
         case 62: return zsf4;
-        case 63: return flag.read();
+        case 63:
+            if (flag_pending) {
+                RebuildFlag();
+            }
+            return flag.read();
         default: return 0; break;
     }
 }
@@ -282,9 +440,9 @@ void GTE::Write(uint32_t reg_num, uint32_t data) {
             light_color[2][1] = data >> 16;
             break;
         case 52: light_color[2][2] = data & 0xFFFFu; break;
-        case 53: far_color.r = data & 0xFFFFu; break;
-        case 54: far_color.g = data & 0xFFFFu; break;
-        case 55: far_color.b = data & 0xFFFFu; break;
+        case 53: far_color.r = data; break;
+        case 54: far_color.g = data; break;
+        case 55: far_color.b = data; break;
         case 56: offset_x = data; break;
         case 57: offset_y = data; break;
         case 58: h = data; break;
@@ -292,7 +450,10 @@ void GTE::Write(uint32_t reg_num, uint32_t data) {
         case 60: dqb = data; break;
         case 61: zsf3 = data; break;
         case 62: zsf4 = data; break;
-        case 63: flag.reg = data & 0x7FFFF000; break;
+        case 63:
+            flag.reg = data & 0x7FFFF000;
+            flag_pending = false;
+            break;
         default:
             break;
     }
@@ -307,22 +468,88 @@ uint32_t GTE::GetConversionOutput() {
 }
 
 void GTE::ExecuteGTECommand(uint32_t inst) {
-    flag.reg = 0;
     current_inst = GTEInstruction{inst};
-    switch (current_inst.cmd_num) {
-        case 0x01: RTPS(0); break;
-        case 0x06: NCLIP(); break;
-        case 0x12: MVMVA(); break;
-        case 0x1B: NCCS(0); break;
-        case 0x30: RTPT(); break;
-        case 0x3F: NCCT(); break;
-        default:
-            printf("Unhandled GTE command: %08x\n GTE opcode: %02x\n", inst, current_inst.cmd_num);
-            assert(false);
-            break;
+    if (lazy_flags) {
+        flag_inputs = *this;
+        flag_pending = true;
+    } else {
+        flag.reg = 0;
     }
+    const Command& command = command_table[current_inst.sf * 2 + current_inst.lm][current_inst.cmd_num];
+    (this->*command.handler)();
 }
 
+void GTE::SetLazyFlags(bool enable) {
+    if (flag_pending) {
+        RebuildFlag();
+    }
+    lazy_flags = enable;
+    track_flags = !enable;
+}
+
+void GTE::RebuildFlag() {
+    // Commands are deterministic, so running the last one again on its inputs
+    // gives the exact FLAG it would have produced
+    GTERegisters outputs = *this;
+    static_cast<GTERegisters&>(*this) = flag_inputs;
+    flag.reg = 0;
+    track_flags = true;
+    const Command& command = command_table[current_inst.sf * 2 + current_inst.lm][current_inst.cmd_num];
+    (this->*command.handler)();
+    track_flags = !lazy_flags;
+    static_cast<GTERegisters&>(*this) = outputs;
+    flag_pending = false;
+}
+
+uint32_t GTE::GetCommandCycles(uint32_t inst) {
+    GTEInstruction command{inst};
+    return command_table[0][command.cmd_num].cycles;
+}
+
+template <bool sf, bool lm>
+constexpr std::array<GTE::Command, 64> GTE::GenerateCommands() {
+    std::array<Command, 64> commands{};
+    for (Command& command : commands) {
+        command = {&GTE::UnhandledCommand, 0};
+    }
+    commands[0x01] = {&GTE::RTPS<sf, lm>, 15};
+    commands[0x06] = {&GTE::NCLIP<sf, lm>, 8};
+    commands[0x0C] = {&GTE::OP<sf, lm>, 6};
+    commands[0x10] = {&GTE::DPCS<sf, lm>, 8};
+    commands[0x11] = {&GTE::INTPL<sf, lm>, 8};
+    commands[0x12] = {&GTE::MVMVA<sf, lm>, 8};
+    commands[0x13] = {&GTE::NCDS<sf, lm>, 19};
+    commands[0x14] = {&GTE::CDP<sf, lm>, 13};
+    commands[0x16] = {&GTE::NCDT<sf, lm>, 44};
+    commands[0x1B] = {&GTE::NCCS<sf, lm>, 17};
+    commands[0x1C] = {&GTE::CC<sf, lm>, 11};
+    commands[0x1E] = {&GTE::NCS<sf, lm>, 14};
+    commands[0x20] = {&GTE::NCT<sf, lm>, 30};
+    commands[0x28] = {&GTE::SQR<sf, lm>, 5};
+    commands[0x29] = {&GTE::DCPL<sf, lm>, 8};
+    commands[0x2A] = {&GTE::DPCT<sf, lm>, 17};
+    commands[0x2D] = {&GTE::AVSZ3<sf, lm>, 5};
+    commands[0x2E] = {&GTE::AVSZ4<sf, lm>, 6};
+    commands[0x30] = {&GTE::RTPT<sf, lm>, 23};
+    commands[0x3D] = {&GTE::GPF<sf, lm>, 5};
+    commands[0x3E] = {&GTE::GPL<sf, lm>, 5};
+    commands[0x3F] = {&GTE::NCCT<sf, lm>, 39};
+    return commands;
+}
+
+constexpr GTE::CommandTable GTE::GenerateCommandTable() {
+    return {GenerateCommands<false, false>(), GenerateCommands<false, true>(),
+        GenerateCommands<true, false>(), GenerateCommands<true, true>()};
+}
+
+constexpr GTE::CommandTable GTE::command_table = GTE::GenerateCommandTable();
+
+void GTE::UnhandledCommand() {
+    printf("Unhandled GTE command: %08x\n GTE opcode: %02x\n", current_inst.inst, current_inst.cmd_num);
+    assert(false);
+}
+
+template <bool sf, bool lm>
 void GTE::MVMVA() {
     Matrix mx{};
     if (current_inst.mult_mat == 0) {
@@ -346,95 +573,298 @@ void GTE::MVMVA() {
         vx = v[current_inst.mult_vec];
     }
 
-    Vec3 tx{};
-    if (current_inst.trans_vec == 0) {
-        tx = trans_vec;
-    } else if (current_inst.trans_vec == 1) {
-        tx = bg_color;
-    } else if (current_inst.trans_vec == 2) {
-        tx = far_color;
-        // TODO: fix bugged MVMVA for this case;
-    }
-    MultMatrixByVector(mx, vx, tx);
-}
-
-void GTE::RTPS(int vector) {
-    MultMatrixByVector(rotation, v[vector], trans_vec);
-    sz[3] = mac[3] >> ((1 - current_inst.sf) * 12);
-
-    //perform the UNR division algo
-    uint32_t n = 0;
-    if (h < sz[3] * 2) {
-        uint32_t z = GetLeadingZeroes(sz[3]);
-        n = h << z;
-        uint32_t d = sz[3] << z;
-        uint32_t u = UNR_table[(d - 0x7FC0) >> 7] + 0x101;
-        d = ((0x2000080 - (d * u)) >> 8);
-        d = ((0x0000080 + (d * u)) >> 8);
-        n = std::min((unsigned int)0x1FFFF, (((n * d) + 0x8000) >> 16));
+    VectorResults results;
+    if (current_inst.trans_vec == 2) {
+        // With FC the first column only affects the flags, the result is the other two
+        for (int i = 0; i < 3; i++) {
+            int64_t first = ((int64_t)far_color[i] << 12) + mx[i][0] * vx.x;
+            int32_t value = (int32_t)(sf ? first >> 12 : first);
+            clamp(value, 0x7FFF, -0x8000, (Flag)((uint32_t)Flag::Ir1Saturated >> i));
+        }
+        Matrix rest = mx;
+        rest[0][0] = rest[1][0] = rest[2][0] = 0;
+        TransformVectors<sf, lm>(rest, &vx, 1, LongVec3(0), results);
     } else {
-        n = 0x1FFFF;
+        LongVec3 tx(0);
+        if (current_inst.trans_vec == 0) {
+            tx = trans_vec;
+        } else if (current_inst.trans_vec == 1) {
+            tx = bg_color;
+        }
+        TransformVectors<sf, lm>(mx, &vx, 1, tx, results);
+    }
+    LoadMacAndIr(results, 0);
+}
+
+template <bool sf, bool lm>
+void GTE::RTPS() {
+    VectorResults results;
+    TransformVectors<sf, lm>(rotation, &v[0], 1, trans_vec, results);
+    LoadMacAndIr(results, 0);
+    Project<sf, lm>();
+}
+
+template <bool sf, bool lm>
+void GTE::RTPT() {
+    // The three transforms are independent, only the projections are sequential
+    VectorResults results;
+    TransformVectors<sf, lm>(rotation, v, 3, trans_vec, results);
+    for (int i = 0; i < 3; i++) {
+        LoadMacAndIr(results, i);
+        Project<sf, lm>();
+    }
+}
+
+template <bool sf, bool lm>
+void GTE::Project() {
+    PushZ(mac[3] >> (sf ? 0 : 12));
+    uint32_t n = Divide(h, sz[3]);
+    if (h >= sz[3] * 2 && track_flags) {
         flag.div_overflow = 1;
-        flag.error_flag = 1;
     }
 
-    int32_t x = (((int64_t)n * ir[1]) + offset_x) >> 16;
+    int64_t x = (int64_t)n * ir[1] + offset_x;
     SetArithmeticFlags<32>(x, Flag::Mac0OverflowNegative, Flag::Mac0OverflowPositive);
-    int32_t y = (n * ir[2] + offset_y) >> 16;
+    int64_t y = (int64_t)n * ir[2] + offset_y;
     SetArithmeticFlags<32>(y, Flag::Mac0OverflowNegative, Flag::Mac0OverflowPositive);
-    PushScreenXY(x, y);
+    PushScreenXY((int32_t)(x >> 16), (int32_t)(y >> 16));
 
-    mac[0] = n * dqa + dqb;
-    SetArithmeticFlags<32>(mac[0], Flag::Mac0OverflowNegative, Flag::Mac0OverflowPositive);
-    ir[0] = clamp(mac[0] >> 12, 0x1000, 0, Flag::Ir0Saturated);
+    int64_t depth = (int64_t)n * dqa + dqb;
+    SetArithmeticFlags<32>(depth, Flag::Mac0OverflowNegative, Flag::Mac0OverflowPositive);
+    mac[0] = (int32_t)depth;
+    ir[0] = clamp((int32_t)(depth >> 12), 0x1000, 0, Flag::Ir0Saturated);
 }
 
-void GTE::RTPT() {
-    RTPS(0);
-    RTPS(1);
-    RTPS(2);
+uint32_t GTE::Divide(uint16_t h, uint16_t sz3) {
+    if (h >= sz3 * 2) {
+        return 0x1FFFF;
+    }
+    // Normalize SZ3 to 0x8000...0xFFFF and refine the table guess into a 17 bit reciprocal
+    uint32_t z = GetLeadingZeroes(sz3);
+    uint64_t n = (uint64_t)h << z;
+    uint32_t d = sz3 << z;
+    uint32_t u = kUNRTable[(d - 0x7FC0) >> 7] + 0x101;
+    d = (0x2000080 - d * u) >> 8;
+    d = (0x0000080 + d * u) >> 8;
+    return (uint32_t)std::min<uint64_t>(0x1FFFF, (n * d + 0x8000) >> 16);
 }
 
+template <bool sf, bool lm>
 void GTE::NCLIP() {
-    mac[0] = sxy[0].x * sxy[1].y + sxy[1].x * sxy[2].y + sxy[2].x * sxy[0].y 
+    int64_t value = (int64_t)sxy[0].x * sxy[1].y + sxy[1].x * sxy[2].y + sxy[2].x * sxy[0].y
         - sxy[0].x * sxy[2].y - sxy[1].x * sxy[0].y - sxy[2].x * sxy[1].y;
-    SetArithmeticFlags<32>(mac[0], Flag::Mac0OverflowNegative, Flag::Mac0OverflowPositive);
+    SetArithmeticFlags<32>(value, Flag::Mac0OverflowNegative, Flag::Mac0OverflowPositive);
+    mac[0] = (int32_t)value;
 }
 
-void GTE::NCCS(int vector) {
-    MultMatrixByVector(light_source, v[vector]);
-    MultMatrixByVector(light_color, GetIrVector(), bg_color);
-    MultVectorByVector(GetRGBCVector(), GetIrVector());
-    PushColor(mac[1] >> 4, mac[2] >> 4, mac[3] >> 4);
+template <bool sf, bool lm>
+void GTE::AVSZ3() {
+    int64_t value = (int64_t)zsf3 * (sz[1] + sz[2] + sz[3]);
+    SetArithmeticFlags<32>(value, Flag::Mac0OverflowNegative, Flag::Mac0OverflowPositive);
+    mac[0] = (int32_t)value;
+    average_z = clamp((int32_t)(value >> 12), 0xFFFF, 0, Flag::Sz3OtzSaturated);
+}
+
+template <bool sf, bool lm>
+void GTE::AVSZ4() {
+    int64_t value = (int64_t)zsf4 * (sz[0] + sz[1] + sz[2] + sz[3]);
+    SetArithmeticFlags<32>(value, Flag::Mac0OverflowNegative, Flag::Mac0OverflowPositive);
+    mac[0] = (int32_t)value;
+    average_z = clamp((int32_t)(value >> 12), 0xFFFF, 0, Flag::Sz3OtzSaturated);
+}
+
+template <bool sf, bool lm>
+void GTE::SQR() {
+    SetMacAndIr<1, sf, lm>((int64_t)ir[1] * ir[1]);
+    SetMacAndIr<2, sf, lm>((int64_t)ir[2] * ir[2]);
+    SetMacAndIr<3, sf, lm>((int64_t)ir[3] * ir[3]);
+}
+
+template <bool sf, bool lm>
+void GTE::OP() {
+    // Cross product of IR and the rotation matrix diagonal
+    int64_t d1 = rotation[0][0], d2 = rotation[1][1], d3 = rotation[2][2];
+    int64_t ir1 = ir[1], ir2 = ir[2], ir3 = ir[3];
+    SetMacAndIr<1, sf, lm>(ir3 * d2 - ir2 * d3);
+    SetMacAndIr<2, sf, lm>(ir1 * d3 - ir3 * d1);
+    SetMacAndIr<3, sf, lm>(ir2 * d1 - ir1 * d2);
+}
+
+template <bool sf, bool lm>
+void GTE::GPF() {
+    SetMacAndIr<1, sf, lm>((int64_t)ir[0] * ir[1]);
+    SetMacAndIr<2, sf, lm>((int64_t)ir[0] * ir[2]);
+    SetMacAndIr<3, sf, lm>((int64_t)ir[0] * ir[3]);
+    PushColorFromMac();
+}
+
+template <bool sf, bool lm>
+void GTE::GPL() {
+    const int shift = sf ? 12 : 0;
+    SetMacAndIr<1, sf, lm>(((int64_t)mac[1] << shift) + (int64_t)ir[0] * ir[1]);
+    SetMacAndIr<2, sf, lm>(((int64_t)mac[2] << shift) + (int64_t)ir[0] * ir[2]);
+    SetMacAndIr<3, sf, lm>(((int64_t)mac[3] << shift) + (int64_t)ir[0] * ir[3]);
+    PushColorFromMac();
+}
+
+template <bool sf, bool lm>
+void GTE::InterpolateColor(int64_t mac1, int64_t mac2, int64_t mac3) {
+    // MAC + (FC - MAC) * IR0, the intermediate IR always saturates as if lm was 0
+    SetMacAndIr<1, sf, false>(((int64_t)far_color.r << 12) - mac1);
+    SetMacAndIr<2, sf, false>(((int64_t)far_color.g << 12) - mac2);
+    SetMacAndIr<3, sf, false>(((int64_t)far_color.b << 12) - mac3);
+    SetMacAndIr<1, sf, lm>((int64_t)ir[1] * ir[0] + mac1);
+    SetMacAndIr<2, sf, lm>((int64_t)ir[2] * ir[0] + mac2);
+    SetMacAndIr<3, sf, lm>((int64_t)ir[3] * ir[0] + mac3);
+}
+
+template <bool sf, bool lm>
+void GTE::DPCS() {
+    InterpolateColor<sf, lm>((int64_t)rgbc.r << 16, (int64_t)rgbc.g << 16, (int64_t)rgbc.b << 16);
+    PushColorFromMac();
+}
+
+template <bool sf, bool lm>
+void GTE::DPCT() {
+    // Works on the oldest color FIFO entry, which every push replaces
+    for (int i = 0; i < 3; i++) {
+        InterpolateColor<sf, lm>((int64_t)rgb[0].r << 16, (int64_t)rgb[0].g << 16,
+            (int64_t)rgb[0].b << 16);
+        PushColorFromMac();
+    }
+}
+
+template <bool sf, bool lm>
+void GTE::INTPL() {
+    InterpolateColor<sf, lm>((int64_t)ir[1] << 12, (int64_t)ir[2] << 12, (int64_t)ir[3] << 12);
+    PushColorFromMac();
 }
 
+template <bool sf, bool lm>
+void GTE::DCPL() {
+    InterpolateColor<sf, lm>(((int64_t)rgbc.r * ir[1]) << 4, ((int64_t)rgbc.g * ir[2]) << 4,
+        ((int64_t)rgbc.b * ir[3]) << 4);
+    PushColorFromMac();
+}
+
+template <bool sf, bool lm>
+void GTE::CC() {
+    VectorResults results;
+    Vec3 vx = GetIrVector();
+    TransformVectors<sf, lm>(light_color, &vx, 1, bg_color, results);
+    LoadMacAndIr(results, 0);
+    SetMacAndIr<1, sf, lm>(((int64_t)rgbc.r * ir[1]) << 4);
+    SetMacAndIr<2, sf, lm>(((int64_t)rgbc.g * ir[2]) << 4);
+    SetMacAndIr<3, sf, lm>(((int64_t)rgbc.b * ir[3]) << 4);
+    PushColorFromMac();
+}
+
+template <bool sf, bool lm>
+void GTE::CDP() {
+    VectorResults results;
+    Vec3 vx = GetIrVector();
+    TransformVectors<sf, lm>(light_color, &vx, 1, bg_color, results);
+    LoadMacAndIr(results, 0);
+    DCPL<sf, lm>();
+}
+
+template <bool sf, bool lm, GTE::ColorMode mode>
+void GTE::NormalColor(int count) {
+    // Every stage runs on all vectors before the next one
+    VectorResults results;
+    Vec3 vectors[3];
+    TransformVectors<sf, lm>(light_source, v, count, LongVec3(0), results);
+    for (int i = 0; i < count; i++) {
+        vectors[i] = Vec3(results.ir[i][0], results.ir[i][1], results.ir[i][2]);
+    }
+    TransformVectors<sf, lm>(light_color, vectors, count, bg_color, results);
+    if constexpr (mode == ColorMode::Color) {
+        // The color multiply is a diagonal matrix
+        for (int i = 0; i < count; i++) {
+            vectors[i] = Vec3(results.ir[i][0], results.ir[i][1], results.ir[i][2]);
+        }
+        Vec3 color = GetRGBCVector();
+        Matrix diagonal{};
+        diagonal[0][0] = color.x;
+        diagonal[1][1] = color.y;
+        diagonal[2][2] = color.z;
+        TransformVectors<sf, lm>(diagonal, vectors, count, LongVec3(0), results);
+    }
+    for (int i = 0; i < count; i++) {
+        LoadMacAndIr(results, i);
+        if constexpr (mode == ColorMode::DepthCue) {
+            DCPL<sf, lm>();
+        } else {
+            PushColorFromMac();
+        }
+    }
+}
+
+template <bool sf, bool lm>
+void GTE::NCS() {
+    NormalColor<sf, lm, ColorMode::None>(1);
+}
+
+template <bool sf, bool lm>
+void GTE::NCT() {
+    NormalColor<sf, lm, ColorMode::None>(3);
+}
+
+template <bool sf, bool lm>
+void GTE::NCCS() {
+    NormalColor<sf, lm, ColorMode::Color>(1);
+}
+
+template <bool sf, bool lm>
 void GTE::NCCT() {
-    NCCS(0);
-    NCCS(1);
-    NCCS(2);
+    NormalColor<sf, lm, ColorMode::Color>(3);
 }
 
-void GTE::MultMatrixByVector(const Matrix& m, const Vec3& v, const Vec3& tr) {
-    SetMacAndIr<1>((tr.x << 12) + (m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z));
-    SetMacAndIr<2>((tr.y << 12) + (m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z));
-    SetMacAndIr<3>((tr.z << 12) + (m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z));
+template <bool sf, bool lm>
+void GTE::NCDS() {
+    NormalColor<sf, lm, ColorMode::DepthCue>(1);
 }
 
-void GTE::MultVectorByVector(const Vec3& v1, const Vec3& v2, const Vec3& tr) {
-    SetMacAndIr<1>((tr.x << 12) + v1.x * v2.x);
-    SetMacAndIr<2>((tr.y << 12) + v1.y * v2.y);
-    SetMacAndIr<3>((tr.z << 12) + v1.z * v2.z);
+template <bool sf, bool lm>
+void GTE::NCDT() {
+    NormalColor<sf, lm, ColorMode::DepthCue>(3);
+}
+
+template <bool sf, bool lm>
+void GTE::TransformVectors(const Matrix& m, const Vec3* vectors, int count, const LongVec3& tr,
+    VectorResults& results) {
+    TransformArgs args{};
+    for (int row = 0; row < 3; row++) {
+        for (int column = 0; column < 3; column++) {
+            args.m[row][column] = m[row][column];
+        }
+        args.tr[row] = (int64_t)tr[row] << 12;
+    }
+    for (int i = 0; i < count; i++) {
+        args.v[i][0] = vectors[i].x;
+        args.v[i][1] = vectors[i].y;
+        args.v[i][2] = vectors[i].z;
+    }
+    args.count = count;
+    args.sf = sf;
+    args.ir_min = lm ? 0 : -0x8000;
+    uint32_t flags = TransformKernel(args, results.mac, results.ir);
+    if (track_flags) {
+        flag.reg |= flags;
+    }
 }
 
-constexpr std::array<uint8_t, 0x101> GTE::GenerateUNRTable() {
-    std::array<uint8_t, 0x101> UNR_table{{0}};
-    for (unsigned i = 0; i < UNR_table.size(); i++) {
-        UNR_table[i] = std::min((unsigned)0, (0x40000/(i + 0x100) + 1) / 2 - 0x101);
+void GTE::LoadMacAndIr(const VectorResults& results, int vector) {
+    for (int i = 0; i < 3; i++) {
+        mac[i + 1] = results.mac[vector][i];
+        ir[i + 1] = results.ir[vector][i];
     }
-    return UNR_table;
 }
 
 int32_t GTE::clamp(int32_t val, int32_t max, int32_t min, Flag flags) {
+    if (!track_flags) {
+        return std::clamp(val, min, max);
+    }
     if (val > max) {
         flag.reg |= (uint32_t)flags;
         return max;
@@ -447,21 +877,31 @@ int32_t GTE::clamp(int32_t val, int32_t max, int32_t min, Flag flags) {
 }
 
 void GTE::PushScreenXY(int32_t x, int32_t y) {
-    sxy[0].x = sxy[1].x;
-    sxy[0].y = sxy[1].y;
-    sxy[1].x = sxy[2].x;
-    sxy[1].y = sxy[2].y;
+    sxy[0] = sxy[1];
+    sxy[1] = sxy[2];
     sxy[2].x = clamp(x, 0x3FF, -0x400, Flag::Sx2Saturated);
-    sxy[2].y = clamp(y, 0x3FF, -0x400, Flag::Sx2Saturated);
+    sxy[2].y = clamp(y, 0x3FF, -0x400, Flag::Sy2Saturated);
+}
+
+void GTE::PushZ(int32_t z) {
+    sz[0] = sz[1];
+    sz[1] = sz[2];
+    sz[2] = sz[3];
+    sz[3] = clamp(z, 0xFFFF, 0x0000, Flag::Sz3OtzSaturated);
 }
 
-void GTE::PushColor(uint32_t r, uint32_t g, uint32_t b) {
+void GTE::PushColor(int32_t r, int32_t g, int32_t b) {
     rgb[0] = rgb[1];
     rgb[1] = rgb[2];
 
     rgb[2].r = clamp(r, 0xFF, 0x00, Flag::ColorFifoRSaturated);
     rgb[2].g = clamp(g, 0xFF, 0x00, Flag::ColorFifoGSaturated);
     rgb[2].b = clamp(b, 0xFF, 0x00, Flag::ColorFifoBSaturated);
+    rgb[2].a = rgbc.a;
+}
+
+void GTE::PushColorFromMac() {
+    PushColor(mac[1] >> 4, mac[2] >> 4, mac[3] >> 4);
 }
 
 GTE::Vec3 GTE::GetIrVector() const {
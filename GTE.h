@@ -4,16 +4,60 @@
 #include <glm/glm.hpp>
 #include <array>
 
-class GTE {
+// Everything a GTE command reads or writes apart from FLAG, kept together so the
+// inputs of a command can be saved with a single copy
+struct GTERegisters {
+    using Matrix = glm::mat<3, 3, int16_t>;
+    using Vec3 = glm::vec<3, int16_t>;
+    using LongVec3 = glm::vec<3, int32_t>;
+
+    // Data Registers
+    Vec3 v[3];                                  // r0-5
+    glm::vec<4, uint8_t> rgbc;                  // r6
+    uint16_t average_z = 0;                     // r7
+    int16_t ir[4] = {0, 0, 0, 0};               // r8-11
+    glm::vec<2, int16_t> sxy[4];                // r12-15
+    uint16_t sz[4] = {0, 0, 0, 0};              // r16-19
+    glm::vec<4, uint8_t> rgb[3];                // r20-22
+    uint32_t res1;                              // r23
+    int32_t mac[4] = {0, 0, 0, 0};              // r24-27
+    uint16_t irgb = 0;                          // r28-29
+    int32_t lzcs = 0;                           // r30
+    int32_t lzcr = 0;                           // r31
+
+    // Control Registers
+    Matrix rotation{};                          // r32-36
+    LongVec3 trans_vec;                         // r37-39
+    Matrix light_source{};                      // r40-44
+    LongVec3 bg_color;                          // r45-47
+    Matrix light_color{};                       // r48-52
+    LongVec3 far_color;                         // r53-55
+    int32_t offset_x = 0;                       // r56
+    int32_t offset_y = 0;                       // r57
+    uint16_t h = 0;                             // r58
+    int16_t dqa = 0;                            // r59
+    int32_t dqb = 0;                            // r60
+    int16_t zsf3 = 0;                           // r61
+    int16_t zsf4 = 0;                           // r62
+};
+
+class GTE : private GTERegisters {
 public:
-    GTE();
     uint32_t Read(uint32_t reg_num);
     void Write(uint32_t reg_num, uint32_t data);
     void ExecuteGTECommand(uint32_t inst);
+    static uint32_t GetCommandCycles(uint32_t inst);
+    // H / SZ3 as done by RTPS/RTPT, using the hardware's Newton-Raphson reciprocal.
+    // Saturates to 0x1FFFF (setting the divide overflow flag) when H >= SZ3 * 2
+    static uint32_t Divide(uint16_t h, uint16_t sz3);
+    // Skip the flag bookkeeping while running commands and only rebuild FLAG from
+    // the inputs of the last command once it is actually read. Off by default, saving
+    // the whole register file per command costs more than the flag checks it skips
+    void SetLazyFlags(bool enable);
 private:
+    void RebuildFlag();
+
     uint32_t GetConversionOutput();
-    constexpr std::array<uint8_t, 0x101> GenerateUNRTable();
-    const std::array<uint8_t, 0x101> UNR_table;
 
     union GTEInstruction {
         uint32_t inst = 0;
@@ -30,15 +74,53 @@ private:
             uint32_t cop2_code : 7;     // Must be 0100101b for GTE
         };
     } current_inst;
-    using Matrix = glm::mat<3, 3, int16_t>;
-    using Vec3 = glm::vec<3, int16_t>;
 
-    void RTPS(int vector);
-    void MVMVA();
-    void NCLIP();
-    void NCCS(int vector);
-    void RTPT();
-    void NCCT();
+    // Commands are dispatched through a table indexed by sf, lm and the opcode,
+    // so every handler is compiled once per sf/lm combination
+    using CommandHandler = void (GTE::*)();
+    struct Command {
+        CommandHandler handler;
+        uint8_t cycles;
+    };
+    using CommandTable = std::array<std::array<Command, 64>, 4>;   // [sf * 2 + lm][opcode]
+    static const CommandTable command_table;
+    static constexpr CommandTable GenerateCommandTable();
+    template <bool sf, bool lm>
+    static constexpr std::array<Command, 64> GenerateCommands();
+
+    template <bool sf, bool lm> void RTPS();
+    template <bool sf, bool lm> void RTPT();
+    template <bool sf, bool lm> void NCLIP();
+    template <bool sf, bool lm> void OP();
+    template <bool sf, bool lm> void DPCS();
+    template <bool sf, bool lm> void DPCT();
+    template <bool sf, bool lm> void INTPL();
+    template <bool sf, bool lm> void MVMVA();
+    template <bool sf, bool lm> void NCDS();
+    template <bool sf, bool lm> void NCDT();
+    template <bool sf, bool lm> void CDP();
+    template <bool sf, bool lm> void NCCS();
+    template <bool sf, bool lm> void NCCT();
+    template <bool sf, bool lm> void CC();
+    template <bool sf, bool lm> void NCS();
+    template <bool sf, bool lm> void NCT();
+    template <bool sf, bool lm> void SQR();
+    template <bool sf, bool lm> void DCPL();
+    template <bool sf, bool lm> void AVSZ3();
+    template <bool sf, bool lm> void AVSZ4();
+    template <bool sf, bool lm> void GPF();
+    template <bool sf, bool lm> void GPL();
+    void UnhandledCommand();
+
+    // Shared command stages
+    enum class ColorMode {
+        None,           // NCS/NCT
+        Color,          // NCCS/NCCT
+        DepthCue        // NCDS/NCDT
+    };
+    template <bool sf, bool lm> void Project();
+    template <bool sf, bool lm, ColorMode mode> void NormalColor(int count);
+    template <bool sf, bool lm> void InterpolateColor(int64_t mac1, int64_t mac2, int64_t mac3);
 
     union GTEFlag {
         uint32_t reg = 0;
@@ -93,17 +175,31 @@ private:
         Mac1OverflowPositive = 1 << 30
     };
 
+    // MAC1-3/IR1-3 of up to three vectors transformed at once
+    struct VectorResults {
+        int32_t mac[3][3];      // [vector][MAC1..3]
+        int16_t ir[3][3];       // [vector][IR1..3]
+    };
+
     // Utility Functions
-    void MultMatrixByVector(const Matrix& m, const Vec3& v, const Vec3& tr = Vec3(0));
-    void MultVectorByVector(const Vec3& v1, const Vec3& v2, const Vec3& tr = Vec3(0));
+    // m * vectors[i] + tr for every vector, only the flags are written to the registers
+    template <bool sf, bool lm>
+    void TransformVectors(const Matrix& m, const Vec3* vectors, int count, const LongVec3& tr,
+        VectorResults& results);
+    void LoadMacAndIr(const VectorResults& results, int vector);
     int32_t clamp(int32_t val, int32_t max, int32_t min, Flag flags);
     void PushScreenXY(int32_t x, int32_t y);
-    void PushColor(uint32_t r, uint32_t g, uint32_t b);
+    void PushZ(int32_t z);
+    void PushColor(int32_t r, int32_t g, int32_t b);
+    void PushColorFromMac();
     Vec3 GetIrVector() const;
     Vec3 GetRGBCVector() const;
 
     template <int bits>
     void SetArithmeticFlags(int64_t val, Flag underflow_flag, Flag ov_flag) {
+        if (!track_flags) {
+            return;
+        }
         if (val >= (1LL << (bits - 1))) {
             flag.reg |= (uint32_t)ov_flag;
         }
@@ -112,7 +208,7 @@ private:
         }
     }
 
-    template <int index>
+    template <int index, bool sf>
     void SetMac(int64_t val) {
         if constexpr (index == 1) {
             SetArithmeticFlags<44>(val, Flag::Mac1OverflowNegative, Flag::Mac1OverflowPositive);
@@ -121,13 +217,13 @@ private:
         } else if constexpr (index == 3) {
             SetArithmeticFlags<44>(val, Flag::Mac3OverflowNegative, Flag::Mac3OverflowPositive);
         }
-        if (current_inst.sf) {
+        if constexpr (sf) {
             val >>= 12;
         }
         mac[index] = (int32_t)val;
     }
 
-    template <int index>
+    template <int index, bool lm>
     void SetIr(int32_t val) {
         Flag flag;
         if constexpr (index == 1) {
@@ -137,43 +233,20 @@ private:
         } else if constexpr (index == 3) {
             flag = Flag::Ir3Saturated;
         }
-        ir[index] = clamp(val, 0x7FFF, current_inst.lm ? 0: -0x8000, flag);
+        ir[index] = clamp(val, 0x7FFF, lm ? 0 : -0x8000, flag);
     }
 
-    template <int index>
-    void SetMacAndIr(int32_t val) {
-        SetMac<index>(val);
-        SetIr<index>(val);
+    template <int index, bool sf, bool lm>
+    void SetMacAndIr(int64_t val) {
+        SetMac<index, sf>(val);
+        SetIr<index, lm>(mac[index]);
     }
     
-    // Data Registers
-    Vec3 v[3];                                  // r0-5
-    glm::vec<4, uint8_t> rgbc;                  // r6
-    uint16_t average_z = 0;                     // r7
-    int16_t ir[4] = {0, 0, 0, 0};               // r8-11
-    glm::vec<2, int16_t> sxy[4];                // r12-15
-    uint16_t sz[4] = {0, 0, 0, 0};              // r16-19
-    glm::vec<4, uint8_t> rgb[3];                // r20-22
-    uint32_t res1;                              // r23
-    int32_t mac[4] = {0, 0, 0, 0};              // r24-27
-    uint16_t irgb = 0;                          // r28-29
-    int32_t lzcs = 0;                           // r30
-    int32_t lzcr = 0;                           // r31
-
-    // Control Registers
-    Matrix rotation{};                          // r32-36
-    Vec3 trans_vec;                             // r37-39
-    Matrix light_source{};                      // r40-44
-    Vec3 bg_color;                              // r45-47
-    Matrix light_color{};                       // r48-52
-    Vec3 far_color;                             // r53-55
-    int32_t offset_x = 0;                       // r56
-    int32_t offset_y = 0;                       // r57
-    uint16_t h = 0;                             // r58
-    int16_t dqa = 0;                            // r59
-    int32_t dqb = 0;                            // r60
-    int16_t zsf3 = 0;                           // r61
-    int16_t zsf4 = 0;                           // r62
     GTEFlag flag;                               // r63
+
+    bool lazy_flags = false;
+    bool track_flags = !lazy_flags; // false while running commands with lazy flags
+    bool flag_pending = false;      // FLAG is stale, flag_inputs holds the last command's inputs
+    GTERegisters flag_inputs;
 };
 
@@ -0,0 +1,107 @@
+#include "ISO9660.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+// Directory records store both byte orders, this takes the little-endian half
+static uint32_t ReadU32(const uint8_t* data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+// Upper case without the ";1" version and the trailing dot of names without an extension
+static std::string NormalizeName(std::string name) {
+    name = name.substr(0, name.find(';'));
+    if (!name.empty() && name.back() == '.') {
+        name.pop_back();
+    }
+    std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+    return name;
+}
+
+ISO9660::ISO9660(ReadAhead& reader) : reader(reader) {}
+
+bool ISO9660::ReadFile(const std::string& path, std::vector<uint8_t>& data) {
+    Entry entry;
+    if (!ReadRoot(entry)) {
+        return false;
+    }
+    // Drop the "cdrom:" device, the rest are directories down to the file
+    size_t start = path.find(':');
+    start = start == std::string::npos ? 0 : start + 1;
+    while (start < path.size()) {
+        size_t end = path.find_first_of("\\/", start);
+        if (end == std::string::npos) {
+            end = path.size();
+        }
+        if (end > start) {
+            if (!entry.directory || !FindEntry(entry, NormalizeName(path.substr(start, end - start)), entry)) {
+                return false;
+            }
+        }
+        start = end + 1;
+    }
+    if (entry.directory) {
+        return false;
+    }
+
+    data.resize(entry.size);
+    for (uint32_t offset = 0; offset < entry.size; offset += kUserDataSize) {
+        if (!ReadUserData(entry.sector + offset / kUserDataSize)) {
+            return false;
+        }
+        memcpy(data.data() + offset, user_data, std::min(kUserDataSize, entry.size - offset));
+    }
+    return true;
+}
+
+bool ISO9660::ReadUserData(uint32_t sector) {
+    if (reader.Read(Disk::kLeadInSectors + sector, raw_sector) < Disk::kSectorSize) {
+        return false;
+    }
+    // Skip the sync and header, plus the subheader on mode 2
+    user_data = raw_sector.data() + (raw_sector[15] == 2 ? 24 : 16);
+    return true;
+}
+
+bool ISO9660::ReadRoot(Entry& root) {
+    if (!ReadUserData(kVolumeDescriptorSector)) {
+        return false;
+    }
+    if (user_data[0] != 1 || memcmp(user_data + 1, "CD001", 5) != 0) {
+        printf("No ISO9660 primary volume descriptor\n");
+        return false;
+    }
+    const uint8_t* record = user_data + 156;
+    root.sector = ReadU32(record + 2);
+    root.size = ReadU32(record + 10);
+    root.directory = true;
+    return true;
+}
+
+bool ISO9660::FindEntry(const Entry& directory, const std::string& name, Entry& entry) {
+    for (uint32_t offset = 0; offset < directory.size; offset += kUserDataSize) {
+        if (!ReadUserData(directory.sector + offset / kUserDataSize)) {
+            return false;
+        }
+        // Records don't cross sectors, a zero length pads out the rest of one
+        uint32_t position = 0;
+        while (position + 33 <= kUserDataSize && user_data[position] != 0) {
+            const uint8_t* record = user_data + position;
+            uint8_t name_length = record[32];
+            if (position + 33 + name_length > kUserDataSize) {
+                break;
+            }
+            std::string record_name((const char*)record + 33, name_length);
+            if (NormalizeName(record_name) == name) {
+                entry.sector = ReadU32(record + 2);
+                entry.size = ReadU32(record + 10);
+                entry.directory = record[25] & 0x02;
+                return true;
+            }
+            position += record[0];
+        }
+    }
+    return false;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Disk.h"
+#include "ReadAhead.h"
+
+// Just enough of ISO9660 to find and read files on the data track, no Joliet or
+// multi-extent files. Goes through the read-ahead like the drive does.
+class ISO9660 {
+public:
+    explicit ISO9660(ReadAhead& reader);
+
+    // "SYSTEM.CNF", "cdrom:\DIR\FILE.EXE;1" etc. Case insensitive, ";1" optional
+    bool ReadFile(const std::string& path, std::vector<uint8_t>& data);
+private:
+    static constexpr uint32_t kUserDataSize = 2048;
+    static constexpr uint32_t kVolumeDescriptorSector = 16;
+
+    struct Entry {
+        uint32_t sector = 0;    // from the start of the data track, not absolute
+        uint32_t size = 0;
+        bool directory = false;
+    };
+
+    bool ReadUserData(uint32_t sector);
+    bool ReadRoot(Entry& root);
+    bool FindEntry(const Entry& directory, const std::string& name, Entry& entry);
+
+    ReadAhead& reader;
+    std::array<uint8_t, Disk::kSectorSize> raw_sector{};
+    const uint8_t* user_data = nullptr;     // into raw_sector, set by ReadUserData
+};
@@ -0,0 +1,154 @@
+#include "LZCodec.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+static const int kHashBits = 14;
+static const size_t kMinMatch = 4;
+static const size_t kMaxOffset = 0xFFFF;
+
+static uint32_t Load32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, 4);
+    return value;
+}
+
+static uint32_t Hash(uint32_t value) {
+    return (value * 2654435761u) >> (32 - kHashBits);
+}
+
+// Writes the 15+ part of a length, false if out of room
+static bool WriteLength(size_t length, uint8_t*& out, const uint8_t* out_end) {
+    for (; length >= 255; length -= 255) {
+        if (out == out_end) {
+            return false;
+        }
+        *out++ = 255;
+    }
+    if (out == out_end) {
+        return false;
+    }
+    *out++ = (uint8_t)length;
+    return true;
+}
+
+static bool ReadLength(size_t& length, const uint8_t*& in, const uint8_t* in_end) {
+    uint8_t byte;
+    do {
+        if (in == in_end) {
+            return false;
+        }
+        byte = *in++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+static bool WriteSequence(const uint8_t* literals, size_t literal_length, size_t offset, size_t match_length,
+    uint8_t*& out, const uint8_t* out_end) {
+    if (out == out_end) {
+        return false;
+    }
+    uint8_t* token = out++;
+    *token = (uint8_t)(std::min<size_t>(literal_length, 15) << 4);
+    if (literal_length >= 15 && !WriteLength(literal_length - 15, out, out_end)) {
+        return false;
+    }
+    if ((size_t)(out_end - out) < literal_length) {
+        return false;
+    }
+    memcpy(out, literals, literal_length);
+    out += literal_length;
+    if (match_length == 0) {
+        return true;
+    }
+    if (out_end - out < 2) {
+        return false;
+    }
+    *out++ = (uint8_t)offset;
+    *out++ = (uint8_t)(offset >> 8);
+    size_t length = match_length - kMinMatch;
+    *token |= (uint8_t)std::min<size_t>(length, 15);
+    return length < 15 || WriteLength(length - 15, out, out_end);
+}
+
+size_t LZCodec::Compress(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity) {
+    std::vector<uint32_t> table(1 << kHashBits, 0);
+    uint8_t* out = dst;
+    const uint8_t* out_end = dst + capacity;
+    size_t anchor = 0;  // start of the pending literals
+    size_t pos = 0;
+    // Greedy, only the latest position per hash is remembered
+    while (size >= kMinMatch && pos <= size - kMinMatch) {
+        uint32_t value = Load32(src + pos);
+        uint32_t& slot = table[Hash(value)];
+        size_t candidate = slot;
+        slot = (uint32_t)pos;
+        if (candidate >= pos || pos - candidate > kMaxOffset || Load32(src + candidate) != value) {
+            pos++;
+            continue;
+        }
+        size_t length = kMinMatch;
+        while (pos + length < size && src[candidate + length] == src[pos + length]) {
+            length++;
+        }
+        if (!WriteSequence(src + anchor, pos - anchor, pos - candidate, length, out, out_end)) {
+            return 0;
+        }
+        pos += length;
+        anchor = pos;
+    }
+    if (!WriteSequence(src + anchor, size - anchor, 0, 0, out, out_end)) {
+        return 0;
+    }
+    return out - dst;
+}
+
+bool LZCodec::Decompress(const uint8_t* src, size_t size, uint8_t* dst, size_t dst_size) {
+    const uint8_t* in = src;
+    const uint8_t* in_end = src + size;
+    uint8_t* out = dst;
+    uint8_t* out_end = dst + dst_size;
+    while (in < in_end) {
+        uint8_t token = *in++;
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !ReadLength(literal_length, in, in_end)) {
+            return false;
+        }
+        if ((size_t)(in_end - in) < literal_length || (size_t)(out_end - out) < literal_length) {
+            return false;
+        }
+        memcpy(out, in, literal_length);
+        in += literal_length;
+        out += literal_length;
+        if (in == in_end) {
+            break;
+        }
+
+        if (in_end - in < 2) {
+            return false;
+        }
+        size_t offset = in[0] | (in[1] << 8);
+        in += 2;
+        size_t match_length = token & 0xF;
+        if (match_length == 15 && !ReadLength(match_length, in, in_end)) {
+            return false;
+        }
+        match_length += kMinMatch;
+        if (offset == 0 || offset > (size_t)(out - dst) || (size_t)(out_end - out) < match_length) {
+            return false;
+        }
+        const uint8_t* match = out - offset;
+        if (offset >= match_length) {
+            memcpy(out, match, match_length);
+            out += match_length;
+        } else {
+            // Overlaps its own output (a run), has to go forward a byte at a time
+            for (size_t i = 0; i < match_length; i++) {
+                *out++ = match[i];
+            }
+        }
+    }
+    return out == out_end;
+}
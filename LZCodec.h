@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Small LZ77 block codec in the style of LZ4, for compressed disc images. Each
+// sequence is a token (literal length << 4 | match length - 4), the literals and
+// a 16 bit match offset; lengths of 15 continue in 255 byte steps. The last
+// sequence only has literals
+class LZCodec {
+public:
+    // Returns the compressed size, 0 if it would not fit in capacity
+    static size_t Compress(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity);
+    // Fails on malformed input or if the output isn't exactly dst_size bytes
+    static bool Decompress(const uint8_t* src, size_t size, uint8_t* dst, size_t dst_size);
+};
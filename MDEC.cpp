@@ -1,6 +1,8 @@
 #include "MDEC.h"
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
+#include <cstring>
 
 void MDEC::Write32(uint32_t offset, uint32_t data) {
     switch (offset) {
@@ -9,39 +11,7 @@ void MDEC::Write32(uint32_t offset, uint32_t data) {
                 HandleCommand(data);
                 status.param_words_minus_1 = (params_left - 1) & 0xFFFF;
             } else {
-                switch (curr_cmd) {
-                    case MDEC::MDECCommands::DecodeMacroblock:
-                        break;
-                    case MDEC::MDECCommands::SetQuantTable: {
-                        uint8_t* table_ptr = NULL;
-                        uint32_t base = 0;
-                        if (param_num < 64 / 4) {
-                            base = param_num * 4;
-                            table_ptr = luminance_quant_table.data();
-                        } else if (param_num < 128 / 4) {
-                            base = (param_num - 64 / 4) * 4;
-                            table_ptr = color_quant_table.data();
-                        } else {
-                            break;
-                        }
-
-                        for (int i = 0; i < 4; i++) {
-                            table_ptr[base + i] = data >> (i * 8);
-                        }
-                        break;
-                    }
-                    case MDEC::MDECCommands::SetScaleTable:
-                        for (int i = 0; i < 2; i++) {
-                            idct_table[param_num * 2 + i] = data >> (i * 16);
-                        }
-                        break;
-                    case MDEC::MDECCommands::None:
-                    default:
-                        break;
-                }
-                param_num++;
-                params_left--;
-                status.param_words_minus_1 = (params_left - 1) & 0xFFFF;
+                WriteParams(&data, 1);
             }
             break;
         case 4:
@@ -58,6 +28,56 @@ void MDEC::Write32(uint32_t offset, uint32_t data) {
     }
 }
 
+void MDEC::WriteWords(const uint32_t* data, uint32_t count) {
+    while (count > 0) {
+        if (params_left == 0) {
+            Write32(0, *data++);
+            count--;
+            continue;
+        }
+        // Everything up to the next command word in one go
+        uint32_t run = std::min(count, params_left);
+        WriteParams(data, run);
+        data += run;
+        count -= run;
+    }
+}
+
+// count must not go past the current command's parameters
+void MDEC::WriteParams(const uint32_t* data, uint32_t count) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    switch (curr_cmd) {
+        case MDEC::MDECCommands::SetQuantTable: {
+            // 64 luminance bytes, then 64 color bytes
+            uint32_t offset = param_num * 4;
+            uint32_t end = std::min(offset + count * 4, 128u);
+            for (; offset < end; offset++, bytes++) {
+                if (offset < 64) {
+                    luminance_quant_table[offset] = *bytes;
+                } else {
+                    color_quant_table[offset - 64] = *bytes;
+                }
+            }
+            break;
+        }
+        case MDEC::MDECCommands::SetScaleTable: {
+            uint32_t index = param_num * 2;
+            if (index < idct_table.size()) {
+                uint32_t entries = std::min<uint32_t>(count * 2, (uint32_t)idct_table.size() - index);
+                memcpy(idct_table.data() + index, data, entries * sizeof(int16_t));
+            }
+            break;
+        }
+        case MDEC::MDECCommands::DecodeMacroblock:  // no decoder yet, the data is only consumed
+        case MDEC::MDECCommands::None:
+        default:
+            break;
+    }
+    param_num += count;
+    params_left -= count;
+    status.param_words_minus_1 = (params_left - 1) & 0xFFFF;
+}
+
 uint32_t MDEC::Read32(uint32_t offset) {
     switch (offset) {
         case 4:
@@ -7,8 +7,10 @@ class MDEC {
 public:
     void Write32(uint32_t offset, uint32_t data);
     uint32_t Read32(uint32_t offset);
+    void WriteWords(const uint32_t* data, uint32_t count);
 private:
     void HandleCommand(uint32_t command);
+    void WriteParams(const uint32_t* data, uint32_t count);
 
     uint32_t param_num = 0;
     uint32_t params_left = 0;
@@ -0,0 +1,111 @@
+#include "MappedFile.h"
+
+#include <cstdio>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+bool MappedFile::Open(const std::string& path) {
+    Close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        printf("Could not open %s\n", path.c_str());
+        return false;
+    }
+    LARGE_INTEGER file_size;
+    HANDLE mapping = nullptr;
+    if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    }
+    if (mapping == nullptr) {
+        printf("Could not map %s\n", path.c_str());
+        CloseHandle(file);
+        return false;
+    }
+    file_handle = file;
+    mapping_handle = mapping;
+    data = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    size = data != nullptr ? (size_t)file_size.QuadPart : 0;
+    return data != nullptr;
+#else
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        printf("Could not open %s\n", path.c_str());
+        return false;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+        printf("Could not map %s\n", path.c_str());
+        return false;
+    }
+    void* mapping = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        printf("Could not map %s\n", path.c_str());
+        return false;
+    }
+    data = (const uint8_t*)mapping;
+    size = file_stat.st_size;
+    // Games mostly stream forward, let the kernel read ahead aggressively
+    madvise(mapping, size, MADV_SEQUENTIAL);
+    return true;
+#endif
+}
+
+void MappedFile::Close() {
+#ifdef _WIN32
+    if (data != nullptr) {
+        UnmapViewOfFile(data);
+    }
+    if (mapping_handle != nullptr) {
+        CloseHandle(mapping_handle);
+    }
+    if (file_handle != nullptr) {
+        CloseHandle(file_handle);
+    }
+    file_handle = mapping_handle = nullptr;
+#else
+    if (data != nullptr) {
+        munmap((void*)data, size);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    fd = -1;
+#endif
+    data = nullptr;
+    size = 0;
+}
+
+void MappedFile::Prefetch(size_t offset, size_t length) const {
+    if (offset >= size) {
+        return;
+    }
+    if (length > size - offset) {
+        length = size - offset;
+    }
+#ifdef _WIN32
+    WIN32_MEMORY_RANGE_ENTRY range;
+    range.VirtualAddress = (void*)(data + offset);
+    range.NumberOfBytes = length;
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+    // madvise wants a page aligned start
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size_t aligned = offset & ~(page_size - 1);
+    madvise((void*)(data + aligned), length + (offset - aligned), MADV_WILLNEED);
+#endif
+}
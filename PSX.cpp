@@ -1,8 +1,9 @@
 #include "PSX.h"
 #include "Constants.h"
 
+#include <algorithm>
 #include <cassert>
-#include <fstream>
+#include <cstring>
 
 PSX::PSX() {
     sys_bios = std::make_unique<Bios>(this);
@@ -21,21 +22,47 @@ PSX::PSX() {
     sys_bios->LoadBios("bios/SCPH1001.BIN");
     sys_dma->Init(sys_ram.get(), this, sys_irq.get(), sys_gpu.get(), sys_cdrom.get(), sys_spu.get(), sys_mdec.get());
     sys_gpu->Init(sys_irq.get());
-    sys_cdrom->Init(sys_irq.get());
+    sys_cdrom->Init(sys_irq.get(), sys_spu->GetCDAudio());
     sys_timers->Init(sys_irq.get());
-    sys_cpu->AddBreakpoint(0x80030000);
+    sys_spu->Init(sys_irq.get());
+}
+
+void PSX::LoadDisc(const std::string& path) {
+    sys_cdrom->LoadDisc(path);
+}
+
+bool PSX::EnableFastBoot() {
+    if (!sys_cdrom->ReadBootExe(exe_data)) {
+        return false;
+    }
+    if (exe_data.size() < 0x800 || memcmp(exe_data.data(), "PS-X EXE", 8) != 0) {
+        printf("Boot executable isn't a PS-X EXE\n");
+        exe_data.clear();
+        return false;
+    }
+    memcpy(&exe, exe_data.data(), sizeof(exe));
+    sys_cpu->EnableFastBoot();
+    return true;
+}
+
+void PSX::FastBoot() {
+    LoadExe();
+    LoadExeToCPU();
 }
 
 void PSX::RunFrame() {
     for (;;) {
         const int cycles = 300;
-        if (!sys_cpu->RunInstructions(cycles / 3)) {
+        // The CPU only gets the bus for the part of the slice DMA didn't hold
+        if (!sys_cpu->RunInstructions((cycles - dma_stall_cycles) / 3)) {
             return;
         }
-        sys_dma->Cycle();
-        sys_cdrom->Cycle();
+        dma_stall_cycles = sys_dma->Cycle(cycles);
+        sys_cdrom->Cycle(cycles);
+        sys_spu->Cycle(cycles);
         sys_timers->Cycle(cycles);
         if (sys_gpu->Cycle(cycles)) {
+            sys_spu->CatchUp();
             return;
         }
     }
@@ -45,23 +72,43 @@ const GPU::VRAM& PSX::GetVRAM() const {
     return sys_gpu->GetVRAM();
 }
 
-void PSX::LoadExe(const std::string& path) {
-    std::ifstream exe_file(path, std::ios::binary | std::ios::in | std::ios::ate);
-    exe_file.seekg(0, exe_file.end);
-    auto size = exe_file.tellg();
-    exe_file.seekg(0, exe_file.beg);
+void PSX::FlushDeferredDraws() {
+    sys_gpu->FlushDeferredDraws();
+}
 
-    exe_data.resize(size);
-    if (exe_file.is_open()) {
-        exe_file.read((char*)exe_data.data(), size);
-    }
-    exe_file.close();
+bool PSX::IsPAL() const {
+    return sys_gpu->IsPAL();
+}
 
-    memcpy(&exe, exe_data.data(), sizeof(exe));
+void PSX::SetFrameSkip(bool skip) {
+    sys_gpu->SetFrameSkip(skip);
+}
+
+void PSX::SetFieldRendering(bool enable) {
+    sys_gpu->SetFieldRendering(enable);
+}
+
+void PSX::StartGPURecording(const std::string& path) {
+    sys_gpu->StartRecording(path);
+}
 
-    for (uint32_t i = 0; i < exe.dest_size; i++) {
+void PSX::StopGPURecording() {
+    sys_gpu->StopRecording();
+}
+
+size_t PSX::ReadAudio(int16_t* dest, size_t max_frames) {
+    return sys_spu->ReadSamples(dest, max_frames);
+}
+
+void PSX::LoadExe() {
+    uint32_t size = std::min<uint32_t>(exe.dest_size, (uint32_t)exe_data.size() - 0x800);
+    for (uint32_t i = 0; i < size; i++) {
         Write8(exe.dest_addr + i, exe_data[0x800 + i]);
     }
+    // .bss, the BIOS clears it before jumping in
+    for (uint32_t i = 0; i < exe.memfill_size; i++) {
+        Write8(exe.memfill_addr + i, 0);
+    }
 }
 
 void PSX::DumpRAM() {
@@ -18,8 +18,22 @@
 class PSX {
 public:
     PSX();
+    void LoadDisc(const std::string& path);
+    // Skips the BIOS intro and starts the disc's boot executable as soon as the kernel
+    // is up. After LoadDisc, false if the disc has nothing to boot
+    bool EnableFastBoot();
+    void FastBoot();
     void RunFrame();
     const GPU::VRAM& GetVRAM() const;
+    // Call before showing VRAM, draws of skipped frames may still be pending
+    void FlushDeferredDraws();
+    bool IsPAL() const;
+    void SetFrameSkip(bool skip);
+    void SetFieldRendering(bool enable);
+    void StartGPURecording(const std::string& path);
+    void StopGPURecording();
+    // Interleaved 44.1kHz stereo mixed since the last call
+    size_t ReadAudio(int16_t* dest, size_t max_frames);
     void LoadExeToCPU();
     void DumpRAM();
 
@@ -42,6 +56,7 @@ private:
     std::unique_ptr<Joypad> sys_joypad;
     std::unique_ptr<Scratchpad> sys_scratchpad;
     std::unique_ptr<MDEC> sys_mdec;
+    uint32_t dma_stall_cycles = 0;
 
     const uint32_t region_mask[8] = {
     0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF,     // KUSEG
@@ -74,7 +89,7 @@ private:
         char license[60];
     } exe;
 
-    void LoadExe(const std::string& path);
+    void LoadExe();
     std::vector<uint8_t> exe_data{};
 };
 
@@ -17,6 +17,9 @@ public:
     void Write(uint32_t offset, Value data) {
         *(Value*)(memory.data() + offset) = data;
     }
+
+    // Direct access for bulk transfers, the caller checks the range
+    uint8_t* GetPointer(uint32_t offset) { return memory.data() + offset; }
 private:
     std::array<uint8_t, RAM_SIZE> memory;
 };
@@ -0,0 +1,116 @@
+#include "ReadAhead.h"
+
+#include <cstring>
+
+ReadAhead::~ReadAhead() {
+    Stop();
+}
+
+void ReadAhead::Start(const Disk* new_disk) {
+    Stop();
+    disk = new_disk;
+    running = true;
+    streaming = false;
+    count = 0;
+    thread = std::thread(&ReadAhead::Run, this);
+}
+
+void ReadAhead::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wake.notify_one();
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+uint32_t ReadAhead::Read(uint32_t lba, std::span<uint8_t, Disk::kSectorSize> dest) {
+    uint32_t size = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    if (streaming && lba == next_lba && count > 0) {
+        stats.hits++;
+        size = ring[head].size;
+        memcpy(dest.data(), ring[head].data.data(), size);
+        head = (head + 1) % kRingSectors;
+        count--;
+        next_lba++;
+    } else {
+        // Seek, or the I/O thread fell behind. Either way this one has to be read now
+        stats.misses++;
+        Restart(lba + 1);
+        std::lock_guard<std::mutex> disk_lock(disk_mutex);
+        size = ReadSector(lba, dest.data());
+    }
+    lock.unlock();
+    wake.notify_one();
+    return size;
+}
+
+void ReadAhead::Seek(uint32_t lba) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (streaming && lba == next_lba) {
+            return;
+        }
+        Restart(lba);
+    }
+    wake.notify_one();
+}
+
+void ReadAhead::Idle() {
+    std::lock_guard<std::mutex> lock(mutex);
+    streaming = false;
+}
+
+// Caller holds mutex
+void ReadAhead::Restart(uint32_t lba) {
+    generation++;
+    streaming = true;
+    prefetch_pending = true;
+    next_lba = lba;
+    head = 0;
+    count = 0;
+}
+
+// Caller holds disk_mutex
+uint32_t ReadAhead::ReadSector(uint32_t lba, uint8_t* dest) {
+    std::span<const uint8_t> sector;
+    if (disk != nullptr) {
+        sector = disk->ReadSector(lba);
+    }
+    if (!sector.empty()) {
+        memcpy(dest, sector.data(), sector.size());
+    }
+    return (uint32_t)sector.size();
+}
+
+void ReadAhead::Run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running) {
+        wake.wait(lock, [this] { return !running || (streaming && count < kRingSectors); });
+        if (!running) {
+            break;
+        }
+        // Only the I/O thread writes slots past head + count, so the read itself can
+        // happen without holding the lock
+        uint64_t read_generation = generation;
+        uint32_t lba = next_lba + count;
+        Slot& slot = ring[(head + count) % kRingSectors];
+        bool prefetch = prefetch_pending;
+        prefetch_pending = false;
+        lock.unlock();
+        {
+            std::lock_guard<std::mutex> disk_lock(disk_mutex);
+            if (prefetch) {
+                disk->Prefetch(lba, kPrefetchSectors);
+            }
+            slot.size = ReadSector(lba, slot.data.data());
+        }
+        lock.lock();
+        if (generation == read_generation) {
+            count++;
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <thread>
+
+#include "Disk.h"
+
+// Streams sectors ahead of the drive on an I/O thread. Reads are assumed to be
+// sequential from the last requested sector, so during steady streaming the
+// emulation thread only copies finished sectors out of the ring. A request for
+// anything else (a seek) is read synchronously and restarts the prediction there.
+// Once started, every access to the disc has to go through here.
+class ReadAhead {
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+
+    ~ReadAhead();
+    void Start(const Disk* new_disk);
+    void Stop();
+
+    // Emulation thread. Copies the sector into dest, returns its size (0 past the lead-out)
+    uint32_t Read(uint32_t lba, std::span<uint8_t, Disk::kSectorSize> dest);
+    // Starts filling from lba ahead of the first Read, e.g. while the drive seeks
+    void Seek(uint32_t lba);
+    // Stops filling (drive paused), what's already buffered stays
+    void Idle();
+    const Stats& GetStats() const { return stats; }
+private:
+    static constexpr uint32_t kRingSectors = 64;        // ~0.4s at double speed
+    static constexpr uint32_t kPrefetchSectors = 150;   // page cache hint after a seek, 2s at single speed
+
+    struct Slot {
+        std::array<uint8_t, Disk::kSectorSize> data;
+        uint32_t size = 0;
+    };
+
+    void Run();
+    void Restart(uint32_t lba);
+    uint32_t ReadSector(uint32_t lba, uint8_t* dest);
+
+    const Disk* disk = nullptr;
+    std::thread thread;
+    std::mutex mutex;                   // guards everything below but the slot data
+    std::condition_variable wake;
+    std::mutex disk_mutex;              // Disk isn't thread safe
+    bool running = false;
+    bool streaming = false;
+    uint64_t generation = 0;            // bumped on a seek, drops reads still in flight
+    bool prefetch_pending = false;
+    uint32_t next_lba = 0;              // the sector at head
+    uint32_t head = 0;
+    uint32_t count = 0;                 // ready sectors from head on
+    std::array<Slot, kRingSectors> ring;
+    Stats stats;
+};
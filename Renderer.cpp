@@ -56,8 +56,13 @@ void Renderer::DrawPolygon(const std::vector<uint32_t>& commands) {
             points[i] = { vertices[i], colors[i], texcoords[0] };
         }
     }
-    palette = Palette::FromCommand(commands[2]);
-    mode.reg = commands[4 + args.shaded] >> 16;
+    if (args.textured) {
+        palette = Palette::FromCommand(commands[2]);
+        mode.reg = commands[4 + args.shaded] >> 16;
+    } else {
+        // Untextured polygons carry no texpage, blend with the current draw mode
+        mode = gpu->GetDrawMode();
+    }
 
     std::array<Point, 3> point_data = {points[0], points[1], points[2]};
     int area = orient2D(point_data[0].vertex, point_data[1].vertex, point_data[2].vertex);
@@ -93,8 +98,17 @@ void Renderer::DrawTriangle(const PolygonArgs& args, const std::array<Point, 3>&
     max_x = std::min((int)gpu->drawing_area_right, std::min(max_x, (int)1024));
     max_y = std::min((int)gpu->drawing_area_bottom, std::min(max_y, (int)512));
 
+    int line_parity = gpu->GetFieldLineParity();
+    int line_step = 1;
+    if (line_parity >= 0) {
+        line_step = 2;
+        if ((min_y & 1) != line_parity) {
+            min_y++;
+        }
+    }
+
     Vertex v;
-    for (v.y = min_y; v.y < max_y; v.y++) {
+    for (v.y = min_y; v.y < max_y; v.y += line_step) {
         bool entered_row = false;
         for (v.x = min_x; v.x < max_x; v.x++) {
             // calc barycentric coords (not scaled)
@@ -106,15 +120,13 @@ void Renderer::DrawTriangle(const PolygonArgs& args, const std::array<Point, 3>&
                 std::array<int, 3> coords = {w0, w1, w2};
                 Color mono = points[0].color;
                 Color bg, output;
-                if (v.x == 0 && v.y == 0) {
-                    printf("here\n");
-                }
                 bg.raw = gpu->GetVRAMFromPos(v.x, v.y);
                 if (!args.shaded && !args.textured) {
+                    output = mono;
                     if (args.semi_trans) {
                         output = Color::Blend(bg, mono, (SemiTransparency)mode.semi_transparency);
                     }
-                    gpu->SetVRAMFromPos(v.x, v.y, mono.raw);
+                    gpu->SetVRAMFromPos(v.x, v.y, output.raw);
                     continue;
                 }
                 Color interpolated = GetColorFromBarycentricCoords(points, coords);
@@ -198,10 +210,20 @@ void Renderer::DrawRect(const std::vector<uint32_t>& commands) {
     int max_x = std::min((int)gpu->drawing_area_right, std::min((int)(source.x + width), (int)1024));
     int max_y = std::min((int)gpu->drawing_area_bottom, std::min((int)(source.y + height), (int)512));
 
+    int line_parity = gpu->GetFieldLineParity();
+    int line_step = 1;
+    if (line_parity >= 0) {
+        line_step = 2;
+        if ((min_y & 1) != line_parity) {
+            min_y++;
+        }
+    }
+
     for (int x = min_x; x < max_x; x++) {
-        for (int y = min_y; y < max_y; y++) {
+        for (int y = min_y; y < max_y; y += line_step) {
             Color output;
             if (!args.textured) {
+                output = c;
                 if (args.semi_trans) {
                     Color bg;
                     bg.raw = gpu->GetVRAMFromPos(x, y);
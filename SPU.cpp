@@ -1,8 +1,129 @@
 #include "SPU.h"
 #include "Constants.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <cassert>
+#include <cstring>
+
+// Vectorized ADPCM and mixing kernels, selected at compile time like the GTE ones
+#if defined(__SSE4_1__) || defined(__AVX__)
+#define SPU_SSE41 1
+#include <smmintrin.h>
+#endif
+
+static const int kFilterPositive[5] = {0, 60, 115, 98, 122};
+static const int kFilterNegative[5] = {0, 0, -52, -55, -60};
+
+// Expands the 28 nibbles of the ADPCM block at data to (nibble << 12) >> shift.
+// out needs room for 32 samples, the last 4 are garbage
+static void ExpandNibbles(const uint8_t* data, int shift, int16_t* out) {
+#if SPU_SSE41
+	__m128i block = _mm_srli_si128(_mm_loadu_si128((const __m128i*)data), 2);
+	__m128i count = _mm_cvtsi32_si128(shift);
+	__m128i high_mask = _mm_set1_epi16(0xF0);
+	for (int half = 0; half < 2; half++) {
+		__m128i bytes = _mm_cvtepu8_epi16(half == 0 ? block : _mm_srli_si128(block, 8));
+		__m128i low = _mm_slli_epi16(bytes, 12);
+		__m128i high = _mm_slli_epi16(_mm_and_si128(bytes, high_mask), 8);
+		_mm_storeu_si128((__m128i*)(out + half * 16), _mm_sra_epi16(_mm_unpacklo_epi16(low, high), count));
+		_mm_storeu_si128((__m128i*)(out + half * 16 + 8), _mm_sra_epi16(_mm_unpackhi_epi16(low, high), count));
+	}
+#else
+	for (int i = 0; i < 14; i++) {
+		uint8_t byte = data[2 + i];
+		out[i * 2] = (int16_t)(byte << 12) >> shift;
+		out[i * 2 + 1] = (int16_t)((byte & 0xF0) << 8) >> shift;
+	}
+#endif
+}
+
+// left/right[i] += (samples[i] * volume) >> 15
+static void AccumulateVoice(const int16_t* samples, int count, int16_t volume_left, int16_t volume_right,
+	int32_t* left, int32_t* right) {
+	int i = 0;
+#if SPU_SSE41
+	__m128i vol_l = _mm_set1_epi32(volume_left);
+	__m128i vol_r = _mm_set1_epi32(volume_right);
+	for (; i + 4 <= count; i += 4) {
+		__m128i s = _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i*)(samples + i)));
+		__m128i l = _mm_srai_epi32(_mm_mullo_epi32(s, vol_l), 15);
+		__m128i r = _mm_srai_epi32(_mm_mullo_epi32(s, vol_r), 15);
+		_mm_storeu_si128((__m128i*)(left + i), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(left + i)), l));
+		_mm_storeu_si128((__m128i*)(right + i), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(right + i)), r));
+	}
+#endif
+	for (; i < count; i++) {
+		left[i] += (samples[i] * volume_left) >> 15;
+		right[i] += (samples[i] * volume_right) >> 15;
+	}
+}
+
+// Applies the main volume, adds the reverb output, saturates and interleaves into out
+static void OutputStereo(const int32_t* left, const int32_t* right, const int32_t* reverb_left,
+	const int32_t* reverb_right, int count, int16_t volume_left, int16_t volume_right, int16_t* out) {
+	int i = 0;
+#if SPU_SSE41
+	__m128i vol_l = _mm_set1_epi32(volume_left);
+	__m128i vol_r = _mm_set1_epi32(volume_right);
+	for (; i + 4 <= count; i += 4) {
+		// The voice sum saturates before the main volume is applied
+		__m128i l = _mm_packs_epi32(_mm_loadu_si128((const __m128i*)(left + i)), _mm_setzero_si128());
+		__m128i r = _mm_packs_epi32(_mm_loadu_si128((const __m128i*)(right + i)), _mm_setzero_si128());
+		l = _mm_srai_epi32(_mm_mullo_epi32(_mm_cvtepi16_epi32(l), vol_l), 15);
+		r = _mm_srai_epi32(_mm_mullo_epi32(_mm_cvtepi16_epi32(r), vol_r), 15);
+		l = _mm_add_epi32(l, _mm_loadu_si128((const __m128i*)(reverb_left + i)));
+		r = _mm_add_epi32(r, _mm_loadu_si128((const __m128i*)(reverb_right + i)));
+		_mm_storeu_si128((__m128i*)(out + i * 2), _mm_packs_epi32(_mm_unpacklo_epi32(l, r), _mm_unpackhi_epi32(l, r)));
+	}
+#endif
+	for (; i < count; i++) {
+		int32_t l = std::clamp(left[i], -0x8000, 0x7FFF);
+		int32_t r = std::clamp(right[i], -0x8000, 0x7FFF);
+		out[i * 2] = (int16_t)std::clamp(((l * volume_left) >> 15) + reverb_left[i], -0x8000, 0x7FFF);
+		out[i * 2 + 1] = (int16_t)std::clamp(((r * volume_right) >> 15) + reverb_right[i], -0x8000, 0x7FFF);
+	}
+}
+
+// The difference and the results are saturated to 16 bits
+static void ComputeReflections(const int32_t in[4], const int32_t wall[4], const int32_t previous[4],
+	int32_t vWALL, int32_t vIIR, int32_t out[4]) {
+#if SPU_SSE41
+	// (in + wall * vWALL - previous) * vIIR + previous for all four lanes at once
+	__m128i prev = _mm_loadu_si128((const __m128i*)previous);
+	__m128i wall_part = _mm_srai_epi32(_mm_mullo_epi32(_mm_loadu_si128((const __m128i*)wall), _mm_set1_epi32(vWALL)), 15);
+	__m128i value = _mm_sub_epi32(_mm_add_epi32(_mm_loadu_si128((const __m128i*)in), wall_part), prev);
+	value = _mm_cvtepi16_epi32(_mm_packs_epi32(value, value));
+	value = _mm_add_epi32(_mm_srai_epi32(_mm_mullo_epi32(value, _mm_set1_epi32(vIIR)), 15), prev);
+	value = _mm_cvtepi16_epi32(_mm_packs_epi32(value, value));
+	_mm_storeu_si128((__m128i*)out, value);
+#else
+	for (int i = 0; i < 4; i++) {
+		int32_t value = std::clamp(in[i] + ((wall[i] * vWALL) >> 15) - previous[i], -0x8000, 0x7FFF);
+		out[i] = std::clamp(((value * vIIR) >> 15) + previous[i], -0x8000, 0x7FFF);
+	}
+#endif
+}
+
+// Both comb filter sums, taps holds the four left taps followed by the four right ones
+static void ComputeCombs(const int16_t taps[8], const int16_t volumes[4], int32_t out[2]) {
+#if SPU_SSE41
+	__m128i vols = _mm_loadl_epi64((const __m128i*)volumes);
+	vols = _mm_unpacklo_epi64(vols, vols);
+	__m128i products = _mm_madd_epi16(_mm_loadu_si128((const __m128i*)taps), vols);
+	__m128i sums = _mm_hadd_epi32(products, products);
+	out[0] = _mm_cvtsi128_si32(sums) >> 15;
+	out[1] = _mm_extract_epi32(sums, 1) >> 15;
+#else
+	for (int side = 0; side < 2; side++) {
+		int32_t sum = 0;
+		for (int i = 0; i < 4; i++) {
+			sum += taps[side * 4 + i] * volumes[i];
+		}
+		out[side] = sum >> 15;
+	}
+#endif
+}
 
 void SPU::Init(IRQ* irq) {
 	this->irq = irq;
@@ -10,9 +131,21 @@ void SPU::Init(IRQ* irq) {
 }
 
 void SPU::Write16(uint32_t address, uint16_t data) {
+	CatchUp();
+	WriteRegister(address, data);
+	// Key on, IRQ and address changes all move the next IRQ9 hazard
+	UpdateDeadline();
+}
+
+uint16_t SPU::Read16(uint32_t address) {
+	CatchUp();
+	return ReadRegister(address);
+}
+
+void SPU::WriteRegister(uint32_t address, uint16_t data) {
 	uint32_t lsbs = address & 0x00000FFF;	// get least sig 3 bits
 	if (lsbs >= 0xC00 && lsbs + 2 <= 0xD80) {
-		HandleVoiceWrite(address & 0x0F, lsbs / 0x10, data);
+		HandleVoiceWrite(address & 0x0F, (lsbs - 0xC00) / 0x10, data);
 		return;
 	} else if (lsbs >= 0xDC0 && lsbs + 2 <= 0xE00) {
 		uint32_t reg = (lsbs - 0xDC0) / 0x2;
@@ -21,10 +154,10 @@ void SPU::Write16(uint32_t address, uint16_t data) {
 	}
 	switch (lsbs) {
 		case 0xD80:
-			main_volume_l = data;
+			main_left.Set(data);
 			break;
 		case 0xD82:
-			main_volume_r = data;
+			main_right.Set(data);
 			break;
 		case 0xD84:
 			vLOUT = data;
@@ -33,16 +166,24 @@ void SPU::Write16(uint32_t address, uint16_t data) {
 			vROUT = data;
 			break;
 		case 0xD88:
-			key_on.halves[0] = data;
-			break;
 		case 0xD8A:
-			key_on.halves[1] = data;
+			key_on.halves[(lsbs - 0xD88) / 2] = data;
+			for (int i = 0; i < 16; i++) {
+				int voice_num = (lsbs - 0xD88) * 8 + i;
+				if ((data & (1 << i)) && voice_num < 24) {
+					KeyOn(voice_num);
+				}
+			}
 			break;
 		case 0xD8C:
-			key_off.halves[0] = data;
-			break;
 		case 0xD8E:
-			key_off.halves[1] = data;
+			key_off.halves[(lsbs - 0xD8C) / 2] = data;
+			for (int i = 0; i < 16; i++) {
+				int voice_num = (lsbs - 0xD8C) * 8 + i;
+				if ((data & (1 << i)) && voice_num < 24) {
+					KeyOff(voice_num);
+				}
+			}
 			break;
 		case 0xD90:
 			PMON.halves[0] = data;
@@ -70,6 +211,7 @@ void SPU::Write16(uint32_t address, uint16_t data) {
 			break;
 		case 0xDA2:
 			mBASE = data;
+			reverb_address = mBASE * 8;
 			break;
 		case 0xDA4:
 			irq_address = data;
@@ -84,6 +226,10 @@ void SPU::Write16(uint32_t address, uint16_t data) {
 			break;
 		case 0xDAA:
 			SPUCNT.reg = data;
+			SPUSTAT.current_mode = data & 0x3F;
+			if (!SPUCNT.irq9_enable) {
+				SPUSTAT.irq9_flag = false;
+			}
 			break;
 		case 0xDAC:
 			sram_data_transfer_control.reg = data;
@@ -101,10 +247,8 @@ void SPU::Write16(uint32_t address, uint16_t data) {
 			external_input_volume.right = data;
 			break;
 		case 0xDB8:
-			curr_main_volume.left = data;
-			break;
 		case 0xDBA:
-			curr_main_volume.right = data;
+			// Current main volume, read only
 			break;
 		default:
 			printf("Unhandled write to SPU at address %08x\n", address);
@@ -113,12 +257,49 @@ void SPU::Write16(uint32_t address, uint16_t data) {
 	}
 }
 
-uint16_t SPU::Read16(uint32_t address) const {
+void SPU::DMAWrite(const uint32_t* data, uint32_t count) {
+	CatchUp();
+	// Same as writing each halfword to the data port, lower halfword first
+	const uint8_t* src = (const uint8_t*)data;
+	uint32_t size = count * 4;
+	uint32_t start = write_address % spu_ram.size();
+	uint32_t first = std::min(size, (uint32_t)spu_ram.size() - start);
+	memcpy(spu_ram.data() + start, src, first);
+	memcpy(spu_ram.data(), src + first, size - first);
+	MarkDirty(start, size);
+	uint32_t irq_offset = (irq_address * 8 - start) % spu_ram.size();
+	if (SPUCNT.irq9_enable && irq_offset < size) {
+		SPUSTAT.irq9_flag = true;
+		irq->TriggerIRQ(9);
+	}
+	write_address = (start + size) % spu_ram.size();
+	UpdateDeadline();
+}
+
+uint16_t SPU::ReadRegister(uint32_t address) const {
 	uint32_t lsbs = address & 0x00000FFF;	// get 3 least sig bits
 	if (lsbs >= 0xC00 && lsbs + 2 <= 0xD80) {
-		return ReadVoice(address & 0x0F, lsbs / 0x10);
+		return ReadVoice(address & 0x0F, (lsbs - 0xC00) / 0x10);
+	} else if (lsbs >= 0xE00 && lsbs + 2 <= 0xE60) {
+		// Current volume of each voice
+		const Voice& voice = voices[(lsbs - 0xE00) / 4];
+		return (lsbs & 2) ? voice.volume_right.level : voice.volume_left.level;
+	} else if (lsbs >= 0xDC0 && lsbs + 2 <= 0xE00) {
+		return reverb_regs[(lsbs - 0xDC0) / 0x2];
 	}
 	switch (lsbs) {
+		case 0xD80:
+			return main_left.reg;
+			break;
+		case 0xD82:
+			return main_right.reg;
+			break;
+		case 0xD84:
+			return vLOUT;
+			break;
+		case 0xD86:
+			return vROUT;
+			break;
 		case 0xD88:
 			return key_on.halves[0];
 			break;
@@ -131,6 +312,18 @@ uint16_t SPU::Read16(uint32_t address) const {
 		case 0xD8E:
 			return key_off.halves[1];
 			break;
+		case 0xD90:
+			return PMON.halves[0];
+			break;
+		case 0xD92:
+			return PMON.halves[1];
+			break;
+		case 0xD94:
+			return NON.halves[0];
+			break;
+		case 0xD96:
+			return NON.halves[1];
+			break;
 		case 0xD98:
 			return EON.halves[0];
 			break;
@@ -143,6 +336,12 @@ uint16_t SPU::Read16(uint32_t address) const {
 		case 0xD9E:
 			return ENDX.halves[1];
 			break;
+		case 0xDA2:
+			return mBASE;
+			break;
+		case 0xDA4:
+			return irq_address;
+			break;
 		case 0xDA6:
 			return sram_data_transfer_address;
 			break;
@@ -155,11 +354,23 @@ uint16_t SPU::Read16(uint32_t address) const {
 		case 0xDAE:
 			return SPUSTAT.reg;
 			break;
+		case 0xDB0:
+			return CD_input_volume.left;
+			break;
+		case 0xDB2:
+			return CD_input_volume.right;
+			break;
+		case 0xDB4:
+			return external_input_volume.left;
+			break;
+		case 0xDB6:
+			return external_input_volume.right;
+			break;
 		case 0xDB8:
-			return curr_main_volume.left;
+			return main_left.level;
 			break;
 		case 0xDBA:
-			return curr_main_volume.right;
+			return main_right.level;
 			break;
 		default:
 			printf("Unhandled read from SPU at address %08x\n", address);
@@ -172,10 +383,10 @@ uint16_t SPU::Read16(uint32_t address) const {
 void SPU::HandleVoiceWrite(uint16_t offset, uint16_t voice, uint16_t data) {
 	switch (offset) {
 		case 0:
-			voices[voice].volume_left = data;
+			voices[voice].volume_left.Set(data);
 			break;
 		case 2:
-			voices[voice].volume_left = data;
+			voices[voice].volume_right.Set(data);
 			break;
 		case 4:
 			voices[voice].adpcm_sample_rate = data;
@@ -190,10 +401,12 @@ void SPU::HandleVoiceWrite(uint16_t offset, uint16_t voice, uint16_t data) {
 			voices[voice].adsr_upper = data;
 			break;
 		case 12:
-			voices[voice].adsr_curr_vol = data;
+			voices[voice].adsr_curr_vol = (int16_t)data;
 			break;
 		case 14:
 			voices[voice].adpcm_repeat_addr = data;
+			// Loop start flags in the sample data no longer override it
+			voices[voice].ignore_loop_address = voices[voice].phase != ADSRPhase::Off;
 			break;
 		default:
 			printf("Unhandled write to SPU at offset %08x\n", offset);
@@ -205,10 +418,10 @@ void SPU::HandleVoiceWrite(uint16_t offset, uint16_t voice, uint16_t data) {
 uint16_t SPU::ReadVoice(uint16_t offset, uint16_t voice) const {
 	switch (offset) {
 		case 0:
-			return voices[voice].volume_left;
+			return voices[voice].volume_left.reg;
 			break;
 		case 2:
-			return voices[voice].volume_left;
+			return voices[voice].volume_right.reg;
 			break;
 		case 4:
 			return voices[voice].adpcm_sample_rate;
@@ -235,3 +448,561 @@ uint16_t SPU::ReadVoice(uint16_t offset, uint16_t voice) const {
 			break;
 	}
 }
+
+void SPU::Envelope::Reset(uint8_t new_shift, int8_t new_step, bool new_exponential, bool new_decreasing) {
+	counter = 0;
+	shift = new_shift;
+	step = new_step;
+	exponential = new_exponential;
+	decreasing = new_decreasing;
+}
+
+void SPU::Envelope::Tick(int16_t& level) {
+	int32_t cycles = 1 << std::max(0, shift - 11);
+	int32_t amount = step << std::max(0, 11 - shift);
+	if (exponential && !decreasing && level > 0x6000) {
+		cycles *= 4;
+	}
+	if (exponential && decreasing) {
+		amount = (amount * level) >> 15;
+	}
+	if (++counter < cycles) {
+		return;
+	}
+	counter = 0;
+	level = (int16_t)std::clamp(level + amount, 0, 0x7FFF);
+}
+
+void SPU::VolumeSweep::Set(uint16_t data) {
+	reg = data;
+	if ((data & 0x8000) == 0) {
+		// Fixed volume, -4000h..3FFFh in units of 2
+		level = (int16_t)(data << 1);
+		return;
+	}
+	bool decreasing = (data & 0x2000) != 0;
+	int8_t step = decreasing ? -8 + (data & 3) : 7 - (data & 3);
+	envelope.Reset((data >> 2) & 0x1F, step, (data & 0x4000) != 0, decreasing);
+}
+
+void SPU::VolumeSweep::Tick() {
+	if ((reg & 0x8000) == 0) {
+		return;
+	}
+	// Negative phase sweeps towards -7FFFh
+	bool negative = (reg & 0x1000) != 0;
+	int16_t magnitude = negative ? -level : level;
+	envelope.Tick(magnitude);
+	level = negative ? -magnitude : magnitude;
+}
+
+void SPU::Cycle(uint32_t cycles) {
+	pending_cycles += cycles;
+	if (pending_cycles >= deadline_cycles) {
+		CatchUp();
+	}
+}
+
+void SPU::CatchUp() {
+	int count = pending_cycles / kCyclesPerSample;
+	if (count == 0) {
+		return;
+	}
+	pending_cycles %= kCyclesPerSample;
+	Mix(count);
+	UpdateDeadline();
+	// Once per frame, ReadSamples only moves the read offset
+	if (output_read != 0) {
+		output.erase(output.begin(), output.begin() + output_read);
+		output_read = 0;
+	}
+}
+
+void SPU::UpdateDeadline() {
+	uint32_t samples = kCatchUpSamples;
+	if (SPUCNT.irq9_enable) {
+		samples = std::min(samples, GetSamplesUntilIRQ(samples));
+	}
+	deadline_cycles = std::max(samples, 1u) * kCyclesPerSample;
+}
+
+uint32_t SPU::GetSamplesUntilIRQ(uint32_t horizon) const {
+	// Walks the upcoming block fetches of every playing voice. Pitch modulation can
+	// push the step up to 4000h, so modulated voices assume the fastest rate
+	uint32_t irq_byte = irq_address * 8;
+	uint32_t earliest = horizon;
+	for (int voice_num = 0; voice_num < 24; voice_num++) {
+		const Voice& voice = voices[voice_num];
+		if (voice.phase == ADSRPhase::Off) {
+			continue;
+		}
+		bool pitch_modulated = voice_num > 0 && (PMON.reg & (1u << voice_num));
+		uint32_t step = pitch_modulated ? 0x4000 : std::min<uint32_t>(voice.adpcm_sample_rate, 0x4000);
+		if (step == 0) {
+			continue;
+		}
+		const uint32_t block_length = kBlockSamples << 12;
+		uint32_t samples = (block_length - voice.counter + step - 1) / step;
+		uint32_t address = voice.current_address;
+		uint32_t repeat_address = voice.adpcm_repeat_addr * 8;
+		uint8_t flags = voice.block_flags;
+		while (samples < earliest) {
+			address = (flags & 1) ? repeat_address : (address + 16) % spu_ram.size();
+			if ((irq_byte - address) % spu_ram.size() < 16) {
+				earliest = samples;
+				break;
+			}
+			flags = spu_ram[(address + 1) % spu_ram.size()];
+			if ((flags & 4) && !voice.ignore_loop_address) {
+				repeat_address = address;
+			}
+			samples += std::max(block_length / step, 1u);
+		}
+	}
+	return earliest;
+}
+
+size_t SPU::ReadSamples(int16_t* dest, size_t max_frames) {
+	size_t frames = std::min(max_frames, (output.size() - output_read) / 2);
+	memcpy(dest, output.data() + output_read, frames * 2 * sizeof(int16_t));
+	output_read += frames * 2;
+	return frames;
+}
+
+void SPU::KeyOn(int voice_num) {
+	Voice& voice = voices[voice_num];
+	voice.current_address = voice.adpcm_start_addr * 8;
+	voice.counter = 0;
+	voice.ignore_loop_address = false;
+	voice.adpcm_history[0] = voice.adpcm_history[1] = 0;
+	std::fill(std::begin(voice.decoded), std::end(voice.decoded), 0);
+	voice.adsr_curr_vol = 0;
+	SetADSRPhase(voice, ADSRPhase::Attack);
+	ENDX.reg &= ~(1u << voice_num);
+	DecodeBlock(voice);
+}
+
+void SPU::KeyOff(int voice_num) {
+	if (voices[voice_num].phase != ADSRPhase::Off) {
+		SetADSRPhase(voices[voice_num], ADSRPhase::Release);
+	}
+}
+
+void SPU::SetADSRPhase(Voice& voice, ADSRPhase phase) {
+	voice.phase = phase;
+	uint16_t lower = voice.adsr_lower;
+	uint16_t upper = voice.adsr_upper;
+	switch (phase) {
+		case ADSRPhase::Attack:
+			voice.adsr.Reset((lower >> 10) & 0x1F, 7 - ((lower >> 8) & 3), (lower & 0x8000) != 0, false);
+			break;
+		case ADSRPhase::Decay:
+			voice.adsr.Reset((lower >> 4) & 0xF, -8, true, true);
+			break;
+		case ADSRPhase::Sustain: {
+			bool decreasing = (upper & 0x4000) != 0;
+			int8_t step = decreasing ? -8 + ((upper >> 6) & 3) : 7 - ((upper >> 6) & 3);
+			voice.adsr.Reset((upper >> 8) & 0x1F, step, (upper & 0x8000) != 0, decreasing);
+			break;
+		}
+		case ADSRPhase::Release:
+			voice.adsr.Reset(upper & 0x1F, -8, (upper & 0x20) != 0, true);
+			break;
+		default:
+			break;
+	}
+}
+
+void SPU::TickADSR(Voice& voice) {
+	if (voice.phase == ADSRPhase::Off) {
+		return;
+	}
+	voice.adsr.Tick(voice.adsr_curr_vol);
+	switch (voice.phase) {
+		case ADSRPhase::Attack:
+			if (voice.adsr_curr_vol == 0x7FFF) {
+				SetADSRPhase(voice, ADSRPhase::Decay);
+			}
+			break;
+		case ADSRPhase::Decay: {
+			int32_t sustain_level = ((voice.adsr_lower & 0xF) + 1) * 0x800;
+			if (voice.adsr_curr_vol <= sustain_level) {
+				SetADSRPhase(voice, ADSRPhase::Sustain);
+			}
+			break;
+		}
+		case ADSRPhase::Release:
+			if (voice.adsr_curr_vol == 0) {
+				voice.phase = ADSRPhase::Off;
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+void SPU::CheckIRQ(uint32_t address, uint32_t size) {
+	uint32_t irq_offset = (irq_address * 8 - address) % spu_ram.size();
+	if (SPUCNT.irq9_enable && irq_offset < size) {
+		SPUSTAT.irq9_flag = true;
+		irq->TriggerIRQ(9);
+	}
+}
+
+uint32_t SPU::GetCacheSlot(uint32_t unit) {
+	// 16 byte aligned blocks (even units) spread over every slot, odd ones are offset by half the cache
+	return ((unit >> 1) ^ ((unit & 1) * (kCacheEntries / 2))) % kCacheEntries;
+}
+
+void SPU::MarkDirty(uint32_t address, uint32_t size) {
+	uint32_t first = address / 8;
+	uint32_t last = (address + size - 1) / 8;
+	for (uint32_t unit = first; unit <= last; unit++) {
+		uint32_t wrapped = unit % kRAMUnits;
+		dirty_units[wrapped / 64] |= 1ull << (wrapped % 64);
+	}
+}
+
+void SPU::FlushDirty(uint32_t unit) {
+	if ((dirty_units[unit / 64] & (1ull << (unit % 64))) == 0) {
+		return;
+	}
+	// The 8 bytes at unit belong to the blocks starting at unit and at the unit before it
+	for (uint32_t block_unit : {unit, (unit + kRAMUnits - 1) % kRAMUnits}) {
+		DecodedBlock& entry = block_cache[GetCacheSlot(block_unit)];
+		if (entry.unit == block_unit) {
+			entry.unit = kNoUnit;
+		}
+	}
+	dirty_units[unit / 64] &= ~(1ull << (unit % 64));
+}
+
+const int16_t* SPU::GetDecodedBlock(uint32_t address, const uint8_t* block, const int16_t history[2]) {
+	uint32_t unit = address / 8;
+	FlushDirty(unit);
+	FlushDirty((unit + 1) % kRAMUnits);
+
+	int shift = block[0] & 0xF;
+	if (shift > 12) {
+		shift = 9;
+	}
+	int filter = std::min((block[0] >> 4) & 7, 4);
+	// Without a filter the previous samples don't matter, so any history hits
+	DecodedBlock& entry = block_cache[GetCacheSlot(unit)];
+	if (entry.unit == unit
+		&& (filter == 0 || (entry.history[0] == history[0] && entry.history[1] == history[1]))) {
+		cache_stats.hits++;
+		return entry.samples;
+	}
+	cache_stats.misses++;
+	entry.unit = unit;
+	entry.history[0] = history[0];
+	entry.history[1] = history[1];
+
+	int16_t samples[32];
+	ExpandNibbles(block, shift, samples);
+	if (filter == 0) {
+		memcpy(entry.samples, samples, kBlockSamples * sizeof(int16_t));
+	} else {
+		// The filter feeds back the previous outputs, so this part stays scalar
+		int32_t s1 = history[0];
+		int32_t s2 = history[1];
+		int32_t pos = kFilterPositive[filter];
+		int32_t neg = kFilterNegative[filter];
+		for (int i = 0; i < kBlockSamples; i++) {
+			int32_t sample = samples[i] + ((s1 * pos + s2 * neg + 32) >> 6);
+			entry.samples[i] = (int16_t)std::clamp(sample, -0x8000, 0x7FFF);
+			s2 = s1;
+			s1 = entry.samples[i];
+		}
+	}
+	return entry.samples;
+}
+
+const SPU::ADPCMCacheStats& SPU::GetADPCMCacheStats() const {
+	return cache_stats;
+}
+
+CDAudio* SPU::GetCDAudio() {
+	return &cd_audio;
+}
+
+void SPU::DecodeBlock(Voice& voice) {
+	const uint8_t* block = spu_ram.data() + voice.current_address;
+	uint8_t wrapped[16];
+	if (voice.current_address + 16 > spu_ram.size()) {
+		for (uint32_t i = 0; i < 16; i++) {
+			wrapped[i] = spu_ram[(voice.current_address + i) % spu_ram.size()];
+		}
+		block = wrapped;
+	}
+	CheckIRQ(voice.current_address, 16);
+	voice.block_flags = block[1];
+	if ((voice.block_flags & 4) && !voice.ignore_loop_address) {
+		voice.adpcm_repeat_addr = voice.current_address / 8;
+	}
+
+	voice.decoded[0] = voice.decoded[kBlockSamples];
+	int16_t* decoded = voice.decoded + 1;
+	memcpy(decoded, GetDecodedBlock(voice.current_address, block, voice.adpcm_history),
+		kBlockSamples * sizeof(int16_t));
+	voice.adpcm_history[0] = decoded[kBlockSamples - 1];
+	voice.adpcm_history[1] = decoded[kBlockSamples - 2];
+}
+
+void SPU::NextBlock(int voice_num) {
+	Voice& voice = voices[voice_num];
+	if (voice.block_flags & 1) {
+		// Loop end, jump to the repeat address and stop the voice unless it repeats
+		ENDX.reg |= 1u << voice_num;
+		voice.current_address = voice.adpcm_repeat_addr * 8;
+		if ((voice.block_flags & 2) == 0 && voice.phase != ADSRPhase::Off) {
+			SetADSRPhase(voice, ADSRPhase::Release);
+			voice.adsr_curr_vol = 0;
+		}
+	} else {
+		voice.current_address = (voice.current_address + 16) % spu_ram.size();
+	}
+	DecodeBlock(voice);
+}
+
+void SPU::TickNoise() {
+	int32_t step = SPUCNT.noise_freq_step + 4;
+	int32_t shift = SPUCNT.noise_freq_shift;
+	noise_timer -= step;
+	if (noise_timer >= 0) {
+		return;
+	}
+	uint16_t level = noise_level;
+	uint16_t parity = ((level >> 15) ^ (level >> 12) ^ (level >> 11) ^ (level >> 10) ^ 1) & 1;
+	noise_level = (int16_t)((level << 1) | parity);
+	noise_timer += 0x20000 >> shift;
+	if (noise_timer < 0) {
+		noise_timer += 0x20000 >> shift;
+	}
+}
+
+void SPU::MixVoice(int voice_num, int count, int32_t* left, int32_t* right, int32_t* reverb_left,
+	int32_t* reverb_right) {
+	Voice& voice = voices[voice_num];
+	int16_t* samples = voice_outputs[voice_num];
+	if (voice.phase == ADSRPhase::Off) {
+		std::fill(samples, samples + count, 0);
+		voice.output = 0;
+		return;
+	}
+	bool pitch_modulated = voice_num > 0 && (PMON.reg & (1u << voice_num));
+	bool noise = (NON.reg & (1u << voice_num)) != 0;
+	for (int i = 0; i < count; i++) {
+		uint32_t step = voice.adpcm_sample_rate;
+		if (pitch_modulated) {
+			int32_t factor = voice_outputs[voice_num - 1][i] + 0x8000;
+			step = (uint32_t)(((int32_t)(int16_t)step * factor) >> 15) & 0xFFFF;
+		}
+		step = std::min(step, 0x4000u);
+
+		int32_t sample;
+		if (noise) {
+			sample = noise_samples[i];
+		} else {
+			// Linear interpolation between the previous and the current sample
+			uint32_t index = voice.counter >> 12;
+			int32_t fraction = voice.counter & 0xFFF;
+			int32_t previous = voice.decoded[index];
+			sample = previous + (((voice.decoded[index + 1] - previous) * fraction) >> 12);
+		}
+		samples[i] = (int16_t)((sample * voice.adsr_curr_vol) >> 15);
+		TickADSR(voice);
+
+		voice.counter += step;
+		if ((voice.counter >> 12) >= kBlockSamples) {
+			voice.counter -= kBlockSamples << 12;
+			NextBlock(voice_num);
+		}
+	}
+	voice.output = samples[count - 1];
+	AccumulateVoice(samples, count, voice.volume_left.level, voice.volume_right.level, left, right);
+	if (EON.reg & (1u << voice_num)) {
+		AccumulateVoice(samples, count, voice.volume_left.level, voice.volume_right.level, reverb_left,
+			reverb_right);
+	}
+	// Sweeps tick every sample, but the level applied above only changes between blocks
+	for (int i = 0; i < count; i++) {
+		voice.volume_left.Tick();
+		voice.volume_right.Tick();
+	}
+}
+
+void SPU::Mix(int count) {
+	while (count > 0) {
+		int block = std::min(count, kMixBlock);
+		int32_t left[kMixBlock] = {};
+		int32_t right[kMixBlock] = {};
+		int32_t reverb_left[kMixBlock] = {};
+		int32_t reverb_right[kMixBlock] = {};
+		for (int i = 0; i < block; i++) {
+			TickNoise();
+			noise_samples[i] = noise_level;
+		}
+		for (int voice_num = 0; voice_num < 24; voice_num++) {
+			MixVoice(voice_num, block, left, right, reverb_left, reverb_right);
+		}
+		// CD audio keeps streaming while the input is disabled, it just isn't heard
+		int16_t cd_left[kMixBlock];
+		int16_t cd_right[kMixBlock];
+		cd_audio.Mix(block, cd_left, cd_right);
+		if (SPUCNT.CD_audio_enable) {
+			int16_t cd_volume_left = (int16_t)CD_input_volume.left;
+			int16_t cd_volume_right = (int16_t)CD_input_volume.right;
+			AccumulateVoice(cd_left, block, cd_volume_left, 0, left, right);
+			AccumulateVoice(cd_right, block, 0, cd_volume_right, left, right);
+			if (SPUCNT.CD_audio_reverb) {
+				AccumulateVoice(cd_left, block, cd_volume_left, 0, reverb_left, reverb_right);
+				AccumulateVoice(cd_right, block, 0, cd_volume_right, reverb_left, reverb_right);
+			}
+		}
+		// The reverb output replaces its input in place
+		ProcessReverb(reverb_left, reverb_right, block, reverb_left, reverb_right);
+
+		if (output_read == output.size()
+			|| output.size() - output_read + block * 2 > kMaxOutputFrames * 2) {
+			// Everything was drained, or nobody is draining the output and what's there gets dropped
+			output.clear();
+			output_read = 0;
+		}
+		size_t offset = output.size();
+		output.resize(offset + block * 2);
+		if (!SPUCNT.mute_spu) {
+			std::fill(reverb_left, reverb_left + block, 0);
+			std::fill(reverb_right, reverb_right + block, 0);
+		}
+		int16_t volume_left = SPUCNT.mute_spu ? main_left.level : 0;
+		int16_t volume_right = SPUCNT.mute_spu ? main_right.level : 0;
+		OutputStereo(left, right, reverb_left, reverb_right, block, volume_left, volume_right,
+			output.data() + offset);
+		for (int i = 0; i < block; i++) {
+			main_left.Tick();
+			main_right.Tick();
+		}
+		count -= block;
+	}
+}
+
+uint32_t SPU::GetReverbAddress(int32_t offset) const {
+	// The work area spans mBASE to the end of SPU RAM and wraps around inside it
+	uint32_t base = mBASE * 8;
+	uint32_t size = (uint32_t)spu_ram.size() - base;
+	int64_t relative = ((int64_t)reverb_address - base + offset) % size;
+	if (relative < 0) {
+		relative += size;
+	}
+	return base + (uint32_t)relative;
+}
+
+int16_t SPU::ReadReverb(int32_t offset) const {
+	return *(const int16_t*)(spu_ram.data() + (GetReverbAddress(offset) & ~1u));
+}
+
+void SPU::WriteReverb(int32_t offset, int32_t value) {
+	if (!SPUCNT.reverb_master_enable) {
+		return;
+	}
+	uint32_t address = GetReverbAddress(offset) & ~1u;
+	*(int16_t*)(spu_ram.data() + address) = (int16_t)std::clamp(value, -0x8000, 0x7FFF);
+	MarkDirty(address, 2);
+}
+
+void SPU::ReverbTick(int32_t left_in, int32_t right_in) {
+	auto reg = [this](ReverbReg index) { return (int32_t)(int16_t)reverb_regs[index]; };
+	auto addr = [this](ReverbReg index) { return (int32_t)reverb_regs[index] * 8; };
+
+	int32_t l_in = (std::clamp(left_in, -0x8000, 0x7FFF) * reg(vLIN)) >> 15;
+	int32_t r_in = (std::clamp(right_in, -0x8000, 0x7FFF) * reg(vRIN)) >> 15;
+
+	// Same side (L-L, R-R) and different side (R-L, L-R) reflections
+	const int32_t in[4] = {l_in, r_in, l_in, r_in};
+	const int32_t wall[4] = {ReadReverb(addr(dLSAME)), ReadReverb(addr(dRSAME)), ReadReverb(addr(dRDIFF)),
+		ReadReverb(addr(dLDIFF))};
+	const int32_t previous[4] = {ReadReverb(addr(mLSAME) - 2), ReadReverb(addr(mRSAME) - 2),
+		ReadReverb(addr(mLDIFF) - 2), ReadReverb(addr(mRDIFF) - 2)};
+	int32_t reflections[4];
+	ComputeReflections(in, wall, previous, reg(vWALL), reg(vIIR), reflections);
+	WriteReverb(addr(mLSAME), reflections[0]);
+	WriteReverb(addr(mRSAME), reflections[1]);
+	WriteReverb(addr(mLDIFF), reflections[2]);
+	WriteReverb(addr(mRDIFF), reflections[3]);
+
+	// Early echo
+	const int16_t taps[8] = {ReadReverb(addr(mLCOMB1)), ReadReverb(addr(mLCOMB2)), ReadReverb(addr(mLCOMB3)),
+		ReadReverb(addr(mLCOMB4)), ReadReverb(addr(mRCOMB1)), ReadReverb(addr(mRCOMB2)),
+		ReadReverb(addr(mRCOMB3)), ReadReverb(addr(mRCOMB4))};
+	const int16_t comb_volumes[4] = {(int16_t)reg(vCOMB1), (int16_t)reg(vCOMB2), (int16_t)reg(vCOMB3),
+		(int16_t)reg(vCOMB4)};
+	int32_t out[2];
+	ComputeCombs(taps, comb_volumes, out);
+
+	// Late reverb, two all pass filters in series
+	const ReverbReg apf_regs[2][2] = {{mLAPF1, mRAPF1}, {mLAPF2, mRAPF2}};
+	const int32_t apf_delays[2] = {addr(dAPF1), addr(dAPF2)};
+	const int32_t apf_volumes[2] = {reg(vAPF1), reg(vAPF2)};
+	for (int stage = 0; stage < 2; stage++) {
+		for (int side = 0; side < 2; side++) {
+			int32_t target = addr(apf_regs[stage][side]);
+			int32_t delayed = ReadReverb(target - apf_delays[stage]);
+			int32_t value = std::clamp(out[side] - ((apf_volumes[stage] * delayed) >> 15), -0x8000, 0x7FFF);
+			WriteReverb(target, value);
+			out[side] = std::clamp(((value * apf_volumes[stage]) >> 15) + delayed, -0x8000, 0x7FFF);
+		}
+	}
+
+	reverb_output[0] = (out[0] * (int16_t)vLOUT) >> 15;
+	reverb_output[1] = (out[1] * (int16_t)vROUT) >> 15;
+
+	uint32_t next = (reverb_address + 2) & 0x7FFFE;
+	reverb_address = std::max<uint32_t>(mBASE * 8, next);
+}
+
+// Half-band low-pass used for both the 44.1->22.05kHz input and the 22.05->44.1kHz output
+static const int32_t kReverbResampleTaps[39] = {
+	-0x0001, 0x0000, 0x0002, 0x0000, -0x000A, 0x0000, 0x0023, 0x0000,
+	-0x0067, 0x0000, 0x010A, 0x0000, -0x0268, 0x0000, 0x0534, 0x0000,
+	-0x0B90, 0x0000, 0x2806, 0x4000, 0x2806, 0x0000, -0x0B90, 0x0000,
+	0x0534, 0x0000, -0x0268, 0x0000, 0x010A, 0x0000, -0x0067, 0x0000,
+	0x0023, 0x0000, -0x000A, 0x0000, 0x0002, 0x0000, -0x0001,
+};
+
+static int32_t ReverbFIR(const int32_t* window) {
+	int32_t sum = 0;
+	for (int tap = 0; tap < 39; tap++) {
+		sum += window[tap] * kReverbResampleTaps[tap];
+	}
+	return sum;
+}
+
+void SPU::ProcessReverb(const int32_t* left_in, const int32_t* right_in, int count, int32_t* left_out,
+	int32_t* right_out) {
+	const uint32_t window_start = kReverbHistory - (kReverbTaps - 1);
+	for (int i = 0; i < count; i++) {
+		uint32_t pos = reverb_history_pos;
+		int32_t in[2] = {std::clamp(left_in[i], -0x8000, 0x7FFF), std::clamp(right_in[i], -0x8000, 0x7FFF)};
+		int32_t tick[2] = {0, 0};
+		for (int side = 0; side < 2; side++) {
+			reverb_downsample[side][pos] = reverb_downsample[side][pos + kReverbHistory] = in[side];
+		}
+		if (reverb_odd_sample) {
+			int32_t down_left = ReverbFIR(&reverb_downsample[0][pos + window_start]) >> 15;
+			int32_t down_right = ReverbFIR(&reverb_downsample[1][pos + window_start]) >> 15;
+			ReverbTick(std::clamp(down_left, -0x8000, 0x7FFF), std::clamp(down_right, -0x8000, 0x7FFF));
+			tick[0] = reverb_output[0];
+			tick[1] = reverb_output[1];
+		}
+		// Zero stuffing halves the level, hence the extra bit on the way out
+		for (int side = 0; side < 2; side++) {
+			reverb_upsample[side][pos] = reverb_upsample[side][pos + kReverbHistory] = tick[side];
+		}
+		left_out[i] = std::clamp(ReverbFIR(&reverb_upsample[0][pos + window_start]) >> 14, -0x8000, 0x7FFF);
+		right_out[i] = std::clamp(ReverbFIR(&reverb_upsample[1][pos + window_start]) >> 14, -0x8000, 0x7FFF);
+		reverb_history_pos = (pos + 1) % kReverbHistory;
+		reverb_odd_sample = !reverb_odd_sample;
+	}
+}
@@ -2,14 +2,36 @@
 
 #include <cstdint>
 #include <array>
+#include <vector>
 #include "IRQ.h"
+#include "CDAudio.h"
 
 class SPU {
 public:
     void Init(IRQ* irq);
     void Write16(uint32_t address, uint16_t data);
-    uint16_t Read16(uint32_t address) const;
+    // Register accesses first mix every sample up to the current cycle
+    uint16_t Read16(uint32_t address);
     void Write8(uint32_t address, uint8_t data);
+    void DMAWrite(const uint32_t* data, uint32_t count);
+    // Advances the SPU by CPU cycles. Samples are only mixed once kCatchUpSamples
+    // are due, earlier if a voice could reach the IRQ9 address before that
+    void Cycle(uint32_t cycles);
+    // Mixes every sample due so far, called at the end of each frame
+    void CatchUp();
+    // Copies up to max_frames mixed stereo frames (interleaved left/right) into dest
+    size_t ReadSamples(int16_t* dest, size_t max_frames);
+
+    static constexpr uint32_t kCyclesPerSample = 768;  // 33.8688MHz / 44.1kHz
+    static constexpr uint32_t kCatchUpSamples = 64;
+
+    struct ADPCMCacheStats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+    const ADPCMCacheStats& GetADPCMCacheStats() const;
+    // CD input, fed by the CD controller
+    CDAudio* GetCDAudio();
 private:
     std::array<uint8_t, 512 * 1024> spu_ram;
     template <typename Value>
@@ -24,6 +46,7 @@ private:
     template <typename Value>
     void Write(uint32_t address, Value data) {
         *(Value*)(spu_ram.data() + address) = data;
+        MarkDirty(address, sizeof(Value));
         if (SPUCNT.irq9_enable && address == irq_address * 8) {
             SPUSTAT.irq9_flag = true;
             irq->TriggerIRQ(9);
@@ -33,14 +56,19 @@ private:
     IRQ* irq;
     uint16_t irq_address = 0;   // divided by 8
 
-    uint16_t main_volume_l = 0;
-    uint16_t main_volume_r = 0;
     uint16_t vLOUT = 0;
     uint16_t vROUT = 0;
     uint16_t mBASE = 0;
-    uint16_t reverb_regs[32];
+    uint16_t reverb_regs[32] = {};
 
-    void ModifyReverbReg(uint32_t reg, uint16_t data);
+    // reverb_regs indices, addresses (m/d) are in 8 byte units relative to the
+    // current reverb buffer address and volumes (v) are signed 1.15
+    enum ReverbReg {
+        dAPF1, dAPF2, vIIR, vCOMB1, vCOMB2, vCOMB3, vCOMB4, vWALL,
+        vAPF1, vAPF2, mLSAME, mRSAME, mLCOMB1, mRCOMB1, mLCOMB2, mRCOMB2,
+        dLSAME, dRSAME, mLDIFF, mRDIFF, mLCOMB3, mRCOMB3, mLCOMB4, mRCOMB4,
+        dLDIFF, dRDIFF, mLAPF1, mRAPF1, mLAPF2, mRAPF2, vLIN, vRIN
+    };
 
     union SPUControl {  // 0x1F801DAA
         uint16_t reg = 0;
@@ -131,7 +159,8 @@ private:
     struct Volume {
         uint16_t left = 0;      // -8000h to 7FFFh
         uint16_t right = 0;
-    } CD_input_volume, external_input_volume, curr_main_volume;
+    } CD_input_volume, external_input_volume;
+    CDAudio cd_audio;
 
     union SRAMDataTransferControl {
         uint16_t reg = 0;
@@ -145,18 +174,127 @@ private:
     uint16_t sram_data_transfer_address = 0;
     int write_address;
 
+    // ADSR and volume sweep share the same envelope generator
+    struct Envelope {
+        int32_t counter = 0;
+        uint8_t shift = 0;
+        int8_t step = 0;
+        bool exponential = false;
+        bool decreasing = false;
+
+        void Reset(uint8_t new_shift, int8_t new_step, bool new_exponential, bool new_decreasing);
+        void Tick(int16_t& level);
+    };
+
+    struct VolumeSweep {
+        uint16_t reg = 0;
+        int16_t level = 0;
+        Envelope envelope;
+
+        void Set(uint16_t data);
+        void Tick();
+    };
+
+    enum class ADSRPhase {
+        Off,
+        Attack,
+        Decay,
+        Sustain,
+        Release
+    };
+
+    static constexpr int kBlockSamples = 28;    // samples per 16 byte ADPCM block
+
     struct Voice {
-        uint16_t volume_left = 0;
-        uint16_t volume_right = 0;
+        VolumeSweep volume_left;
+        VolumeSweep volume_right;
         uint16_t adpcm_sample_rate = 0;
         uint16_t adpcm_start_addr = 0;
         uint16_t adsr_lower = 0;
         uint16_t adsr_upper = 0;
-        uint16_t adsr_curr_vol = 0;
+        int16_t adsr_curr_vol = 0;
         uint16_t adpcm_repeat_addr = 0;
+
+        ADSRPhase phase = ADSRPhase::Off;
+        Envelope adsr;
+        uint32_t current_address = 0;       // in bytes
+        uint32_t counter = 0;               // pitch counter, sample index in the block with a 12 bit fraction
+        uint8_t block_flags = 0;
+        bool ignore_loop_address = false;   // repeat address was written while playing
+        int16_t adpcm_history[2] = {0, 0};  // previous two decoded samples for the filter
+        int16_t decoded[kBlockSamples + 1]; // last sample of the previous block, then the current block
+        int16_t output = 0;                 // last sample after ADSR, for pitch modulation
     };
     Voice voices[24];
     void HandleVoiceWrite(uint16_t offset, uint16_t voice, uint16_t data);
     uint16_t ReadVoice(uint16_t offset, uint16_t voice) const;
-};
 
+    // Mixer
+    static constexpr int kMixBlock = 32;            // samples mixed per voice at a time
+    static constexpr size_t kMaxOutputFrames = 44100;
+
+    void KeyOn(int voice_num);
+    void KeyOff(int voice_num);
+    void SetADSRPhase(Voice& voice, ADSRPhase phase);
+    void TickADSR(Voice& voice);
+    void DecodeBlock(Voice& voice);
+    const int16_t* GetDecodedBlock(uint32_t address, const uint8_t* block, const int16_t history[2]);
+    void NextBlock(int voice_num);
+    void CheckIRQ(uint32_t address, uint32_t size);
+    void TickNoise();
+    void MixVoice(int voice_num, int count, int32_t* left, int32_t* right, int32_t* reverb_left,
+        int32_t* reverb_right);
+    uint32_t GetReverbAddress(int32_t offset) const;
+    int16_t ReadReverb(int32_t offset) const;
+    void WriteReverb(int32_t offset, int32_t value);
+    void ReverbTick(int32_t left_in, int32_t right_in);
+    void ProcessReverb(const int32_t* left_in, const int32_t* right_in, int count, int32_t* left_out,
+        int32_t* right_out);
+    void Mix(int count);
+
+    void WriteRegister(uint32_t address, uint16_t data);
+    uint16_t ReadRegister(uint32_t address) const;
+    void UpdateDeadline();
+    uint32_t GetSamplesUntilIRQ(uint32_t horizon) const;
+
+    uint32_t pending_cycles = 0;                    // cycles not yet turned into samples
+    uint32_t deadline_cycles = kCatchUpSamples * kCyclesPerSample;
+    int32_t noise_timer = 0;
+    int16_t noise_level = 1;
+    int16_t noise_samples[kMixBlock];
+    // Reverb runs at 22.05kHz, both rate conversions go through the hardware's 39 tap
+    // FIR. The histories are stored twice so a filter window never wraps
+    static constexpr int kReverbTaps = 39;
+    static constexpr uint32_t kReverbHistory = 64;
+    uint32_t reverb_address = 0;                    // current buffer address in bytes
+    bool reverb_odd_sample = false;
+    uint32_t reverb_history_pos = 0;
+    int32_t reverb_downsample[2][kReverbHistory * 2] = {};  // 44.1kHz input
+    int32_t reverb_upsample[2][kReverbHistory * 2] = {};    // 22.05kHz output with zeros in between
+    int32_t reverb_output[2] = {0, 0};              // newest 22.05kHz output
+    VolumeSweep main_left, main_right;
+    int16_t voice_outputs[24][kMixBlock];           // per voice post-ADSR samples of the current block
+    std::vector<int16_t> output;                    // mixed interleaved stereo, drained by ReadSamples
+    size_t output_read = 0;                         // samples of output already drained, compacted in CatchUp
+
+    // Decoded ADPCM blocks, direct mapped by block address in 8 byte units. The filter
+    // makes a block decode differently depending on the previous two samples, so
+    // those are part of the key. Writes to SPU RAM only set bits in dirty_units,
+    // the entries covering a dirty unit are dropped the next time it is decoded
+    struct DecodedBlock {
+        uint32_t unit = kNoUnit;
+        int16_t history[2] = {0, 0};
+        int16_t samples[kBlockSamples];
+    };
+    static constexpr uint32_t kNoUnit = ~0u;
+    static constexpr uint32_t kCacheEntries = 1024;
+    static constexpr uint32_t kRAMUnits = 512 * 1024 / 8;
+
+    static uint32_t GetCacheSlot(uint32_t unit);
+    void MarkDirty(uint32_t address, uint32_t size);
+    void FlushDirty(uint32_t unit);
+
+    std::array<DecodedBlock, kCacheEntries> block_cache;
+    std::array<uint64_t, kRAMUnits / 64> dirty_units{};
+    ADPCMCacheStats cache_stats;
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// Lock-free single producer/single consumer triple buffer. The producer always
+// has a buffer to write into and the consumer only ever sees the newest
+// published buffer, so neither side waits on the other.
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() : buffers(std::make_unique<T[]>(3)) {}
+
+    // Producer side
+    T& GetWriteBuffer() { return buffers[back]; }
+    void Publish() {
+        back = middle.exchange(back | kFreshBit, std::memory_order_acq_rel) & kIndexMask;
+    }
+
+    // Consumer side, returns false if nothing new was published since the last call
+    bool Consume() {
+        if ((middle.load(std::memory_order_relaxed) & kFreshBit) == 0) {
+            return false;
+        }
+        front = middle.exchange(front, std::memory_order_acq_rel) & kIndexMask;
+        return true;
+    }
+    const T& GetReadBuffer() const { return buffers[front]; }
+private:
+    static constexpr uint8_t kIndexMask = 0x3;
+    static constexpr uint8_t kFreshBit = 0x4;
+
+    std::unique_ptr<T[]> buffers;
+    uint8_t back = 0;                   // owned by the producer
+    std::atomic<uint8_t> middle = 1;    // shared, kFreshBit set when unread
+    uint8_t front = 2;                  // owned by the consumer
+};
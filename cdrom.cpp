@@ -1,38 +1,119 @@
 #include "cdrom.h"
+#include "ISO9660.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <cassert>
+#include <cstring>
 
-void cdrom::Cycle() {
+static uint8_t FromBCD(uint8_t value) {
+    return (value >> 4) * 10 + (value & 0xF);
+}
+
+static uint8_t ToBCD(uint32_t value) {
+    return (uint8_t)(((value / 10) << 4) | (value % 10));
+}
+
+void cdrom::Cycle(uint32_t cycles) {
     status.cmd_transmission_busy = 0;
-    if (!irq_fifo.empty()) {
-        if ((irq_enable & 0x7) && (irq_fifo.front() & 0x7)) {
+    if (!irq_fifo.Empty()) {
+        if ((irq_enable & 0x7) && (irq_fifo.Front() & 0x7)) {
             irq->TriggerIRQ(2);
         }
     }
 
-    int magic = 1150;
-    if (!mode.speed) {
-        magic *= 2;
+    if (status_code.read || status_code.play) {
+        cycles_until_read -= (int32_t)cycles;
+        if (cycles_until_read <= 0) {
+            // Carry the remainder so the average rate is exact
+            cycles_until_read += GetCyclesPerSector();
+
+            // Fill the slot the host isn't reading from, if it's still busy with the older
+            // sector the latest one gets dropped like on hardware
+            uint32_t slot = latest_sector ^ 1;
+            if (data_sector == sectors[slot].data() && !IsBufferEmpty()) {
+                slot = latest_sector;
+            }
+            uint32_t size = read_ahead.Read(read_sector, sectors[slot]);
+            read_data = std::span<const uint8_t>(sectors[slot].data(), size);
+            latest_sector = slot;
+            read_sector++;
+
+            if (!RouteAudioSector()) {
+                PushResponse(status_code.reg);
+                irq_fifo.Push(0x1);
+            }
+        }
     }
-    if (status_code.read) {
-        if (--steps_until_read == 0) {
-            steps_until_read = magic;
+}
 
-            read_data = game_disk.read(read_sector - 2 * 75);
-            read_sector++;
+int32_t cdrom::GetCyclesPerSector() const {
+    return mode.speed ? kCyclesPerSector / 2 : kCyclesPerSector;
+}
 
-            PushResponse(status_code.reg);
-            irq_fifo.push_back(0x1);
+// Sends the sector just read to the SPU instead of the data FIFO if it's audio,
+// returns false for data sectors
+bool cdrom::RouteAudioSector() {
+    if (read_data.size() < Disk::kSectorSize) {
+        return false;
+    }
+    if (status_code.play) {
+        if (!muted) {
+            cd_audio->QueueCDDASector(read_data.data());
         }
+        return true;
+    }
+    // Mode 2 sector with the real-time and audio submode bits
+    bool xa_audio = read_data[15] == 2 && (read_data[16 + 2] & 0x44) == 0x44;
+    if (!mode.xa_adpcm || !xa_audio) {
+        return false;
+    }
+    // Sectors of other files/channels are skipped altogether while filtering
+    bool selected = !mode.xa_filter
+        || (read_data[16] == filter_file && read_data[16 + 1] == filter_channel);
+    if (selected && !muted && !adpcm_muted) {
+        cd_audio->QueueXASector(read_data.data());
     }
+    return true;
 }
 
-void cdrom::Init(IRQ* irq) {
+void cdrom::Init(IRQ* irq, CDAudio* cd_audio) {
     this->irq = irq;
+    this->cd_audio = cd_audio;
     mm = ss = sect = 0;
     read_sector = seek_sector = 0;
-    game_disk.LoadGame("games/castlevania_1.BIN");
+}
+
+void cdrom::LoadDisc(const std::string& path) {
+    read_ahead.Stop();
+    game_disk.LoadGame(path);
+    read_ahead.Start(&game_disk);
+}
+
+bool cdrom::ReadBootExe(std::vector<uint8_t>& exe) {
+    ISO9660 iso(read_ahead);
+    std::string boot_path = "PSX.EXE";
+    std::vector<uint8_t> config;
+    if (iso.ReadFile("SYSTEM.CNF", config)) {
+        // BOOT = cdrom:\SLUS_000.67;1
+        std::string text(config.begin(), config.end());
+        size_t boot = text.find("BOOT");
+        size_t equals = text.find('=', boot);
+        if (boot != std::string::npos && equals != std::string::npos) {
+            size_t start = text.find_first_not_of(" \t", equals + 1);
+            size_t end = text.find_first_of(" \t\r\n", start);
+            if (start != std::string::npos) {
+                boot_path = text.substr(start, end == std::string::npos ? std::string::npos : end - start);
+            }
+        }
+    }
+    bool found = iso.ReadFile(boot_path, exe);
+    if (!found) {
+        printf("Could not read the boot executable %s\n", boot_path.c_str());
+    }
+    // Nothing's streaming yet
+    read_ahead.Idle();
+    return found;
 }
 
 void cdrom::Write8(uint32_t offset, uint8_t data) {
@@ -44,9 +125,9 @@ void cdrom::Write8(uint32_t offset, uint8_t data) {
     } else if (offset == 1 && status.index == 3) {
         vol_right_right = data;
     } else if (offset == 2 && status.index == 0) {
-        param_fifo.push_back(data);
+        param_fifo.Push(data);
         status.param_fifo_empty = 0;
-        status.param_fifo_full = param_fifo.size() < 16;
+        status.param_fifo_full = !param_fifo.Full();
     } else if (offset == 2 && status.index == 1) {
         irq_enable = data;
     } else if (offset == 2 && status.index == 2) {
@@ -55,27 +136,28 @@ void cdrom::Write8(uint32_t offset, uint8_t data) {
         vol_right_left = data;
     } else if (offset == 3 && status.index == 0) {
         if (data & 0x80 && IsBufferEmpty()) {
-            data_buffer = read_data;
-            data_buffer_index = 0;
-            status.data_fifo_empty = 1;
+            LoadDataSector();
         } else {
-            data_buffer.clear();
-            data_buffer_index = 0;
+            data_sector = nullptr;
+            data_index = data_end = 0;
             status.data_fifo_empty = 0;
         }
     } else if (offset == 3 && status.index == 1) {
         if (data & 0x40) {      // reset the param FIFO
-            param_fifo.clear();
+            param_fifo.Clear();
             status.param_fifo_empty = 1;
             status.param_fifo_full = 1;
         }
-        if (!irq_fifo.empty()) {
-            irq_fifo.pop_front();
+        if (!irq_fifo.Empty()) {
+            irq_fifo.Pop();
         }
     } else if (offset == 3 && status.index == 2) {
         vol_left_right = data;
     } else if (offset == 3 && status.index == 3) {
-        // Apply Volume changes : Ignored for now
+        adpcm_muted = data & 0x01;
+        if (data & 0x20) {      // apply the volume changes
+            cd_audio->SetVolume(vol_left_left, vol_left_right, vol_right_left, vol_right_right);
+        }
     } else {
         printf("Unhandled CDROM write at offset %01x, data %02x, index %01x\n",
             offset, data, status.index);
@@ -89,10 +171,10 @@ uint8_t cdrom::Read8(uint32_t offset) {
         return status.reg;
     } else if (offset == 1) {
         uint8_t response_byte = 0;
-        if (!response_fifo.empty()) {
-            response_byte = response_fifo.front();
-            response_fifo.pop_front();
-            if (response_fifo.empty()) {
+        if (!response_fifo.Empty()) {
+            response_byte = response_fifo.Front();
+            response_fifo.Pop();
+            if (response_fifo.Empty()) {
                 status.response_fifo_empty = 0;
             }
         }
@@ -101,8 +183,8 @@ uint8_t cdrom::Read8(uint32_t offset) {
         return irq_enable;
     } else if (offset == 3 && (status.index == 1 || status.index == 3)) {
         uint8_t irq = 0;
-        if (!irq_fifo.empty()) {
-            irq = irq_fifo.front();
+        if (!irq_fifo.Empty()) {
+            irq = irq_fifo.Front();
         }
         return 0b11100000 | (irq & 0x7u);
     } else {
@@ -114,30 +196,34 @@ uint8_t cdrom::Read8(uint32_t offset) {
 }
 
 void cdrom::ExecuteCommand(uint8_t opcode) {
-    irq_fifo.clear();
-    response_fifo.clear();
+    irq_fifo.Clear();
+    response_fifo.Clear();
     switch (opcode) {
         case 0x01:  // GetStat
-            response_fifo.push_back(status_code.reg);
+            response_fifo.Push(status_code.reg);
             status.response_fifo_empty = 1;
-            irq_fifo.push_back(0x3);
+            irq_fifo.Push(0x3);
             break;
         case 0x02: SetLoc(); break;
+        case 0x03: Play(); break;
         case 0x06: ReadN(); break;
         case 0x09: Pause(); break;
         case 0x0A: InitCommand(); break;
         case 0x0B: Mute(); break;
         case 0x0C: Demute(); break;
+        case 0x0D: SetFilter(); break;
         case 0x0E: SetMode(); break;
         case 0x13: GetTN(); break;
+        case 0x14: GetTD(); break;
         case 0x15: SeekL(); break;
         case 0x19: TestCommand(GetParam()); break;
+        case 0x1B: ReadN(); break;      // ReadS, no retries to skip here
         default:
             printf("Unhandled CDROM command with opcode %02x\n", opcode);
             assert(false);
             break;
     }
-    param_fifo.clear();
+    param_fifo.Clear();
     status.param_fifo_empty = 1;
     status.param_fifo_full = 1;
     status.cmd_transmission_busy = 1;
@@ -147,12 +233,12 @@ void cdrom::ExecuteCommand(uint8_t opcode) {
 void cdrom::TestCommand(uint8_t command) {
     switch (command) {
         case 0x20:
-            response_fifo.push_back(0x94);
-            response_fifo.push_back(0x09);
-            response_fifo.push_back(0x19);
-            response_fifo.push_back(0xC0);
+            response_fifo.Push(0x94);
+            response_fifo.Push(0x09);
+            response_fifo.Push(0x19);
+            response_fifo.Push(0xC0);
             status.response_fifo_empty = 1;
-            irq_fifo.push_back(0x3);
+            irq_fifo.Push(0x3);
             break;
         default:
             printf("Unhandled CDROM test command with opcode %02x\n", command);
@@ -162,98 +248,158 @@ void cdrom::TestCommand(uint8_t command) {
 }
 
 void cdrom::SetLoc() {
-    uint8_t amm = GetParam();
-    mm = (amm >> 4) * 10 + (amm & 0xF);
-    uint8_t ass = GetParam();
-    ss = (ass >> 4) * 10 + (ass & 0xF);
-    uint8_t asect = GetParam();
-    sect = (asect >> 4) * 10 + (asect & 0xF);
+    mm = FromBCD(GetParam());
+    ss = FromBCD(GetParam());
+    sect = FromBCD(GetParam());
     seek_sector = GetLBA(mm, ss, sect);
 
-    irq_fifo.push_back(0x3);
+    irq_fifo.Push(0x3);
+    PushResponse(status_code.reg);
+}
+
+void cdrom::Play() {
+    // Starts at the given track, or the Setloc position without one (or with track 0)
+    read_sector = seek_sector;
+    uint8_t track_number = param_fifo.Empty() ? 0 : FromBCD(GetParam());
+    for (const Disk::Track& track : game_disk.GetTracks()) {
+        if (track_number != 0 && track.number == track_number) {
+            read_sector = track.start_lba;
+        }
+    }
+    read_ahead.Seek(read_sector);
+    cd_audio->Reset();
+    cycles_until_read = GetCyclesPerSector();
+
+    status_code.reg &= 0x10;
+    status_code.spindle_motor = 1;
+    status_code.play = 1;
+
+    irq_fifo.Push(0x3);
     PushResponse(status_code.reg);
 }
 
 void cdrom::ReadN() {
     read_sector = seek_sector;
+    read_ahead.Seek(read_sector);
+    // A new XA stream, don't count the gap since the last one as an underrun
+    cd_audio->Reset();
+    cycles_until_read = GetCyclesPerSector();
 
     status_code.reg &= 0x10;
     status_code.spindle_motor = 1;
     status_code.read = 1;
 
-    irq_fifo.push_back(0x3);
+    irq_fifo.Push(0x3);
     PushResponse(status_code.reg);
 }
 
 void cdrom::Pause() {
-    irq_fifo.push_back(0x3);
+    read_ahead.Idle();
+    irq_fifo.Push(0x3);
     PushResponse(status_code.reg);
     
     status_code.reg &= 0x10;
     status_code.spindle_motor = 1;
 
-    irq_fifo.push_back(0x2);
+    irq_fifo.Push(0x2);
     PushResponse(status_code.reg);
 }
 
 void cdrom::SeekL() {
     read_sector = seek_sector;
-    irq_fifo.push_back(0x3);
+    read_ahead.Seek(read_sector);
+    irq_fifo.Push(0x3);
     PushResponse(status_code.reg);
 
     status_code.reg &= 0x10;
     status_code.spindle_motor = 1;
     status_code.seek = 1;
 
-    irq_fifo.push_back(0x2);
+    irq_fifo.Push(0x2);
     PushResponse(status_code.reg);
 }
 
 void cdrom::InitCommand() {
-    irq_fifo.push_back(0x3);
+    read_ahead.Idle();
+    irq_fifo.Push(0x3);
     PushResponse(status_code.reg);
     status_code.reg &= 0x10;    // reset everything but the shell open
     status_code.spindle_motor = 1;
     mode.reg = 0;
-    irq_fifo.push_back(0x2);
-    response_fifo.push_back(status_code.reg);
+    irq_fifo.Push(0x2);
+    response_fifo.Push(status_code.reg);
     PushResponse(status_code.reg);
 }
 
 void cdrom::Mute() {
-    irq_fifo.push_back(0x3);
+    muted = true;
+    irq_fifo.Push(0x3);
     PushResponse(status_code.reg);
 }
 
 void cdrom::Demute() {
-    irq_fifo.push_back(0x3);
+    muted = false;
+    irq_fifo.Push(0x3);
+    PushResponse(status_code.reg);
+}
+
+void cdrom::SetFilter() {
+    filter_file = GetParam();
+    filter_channel = GetParam();
+    irq_fifo.Push(0x3);
     PushResponse(status_code.reg);
 }
 
 void cdrom::SetMode() {
-    status_code.reg = GetParam();
-    irq_fifo.push_back(0x3);
+    mode.reg = GetParam();
+    irq_fifo.Push(0x3);
     PushResponse(status_code.reg);
 }
 
 void cdrom::GetTN() {
-    irq_fifo.push_back(0x3);
+    const std::vector<Disk::Track>& tracks = game_disk.GetTracks();
+    irq_fifo.Push(0x3);
     PushResponse(status_code.reg);
-    PushResponse(0x1);
-    PushResponse(0x3);
+    PushResponse(ToBCD(tracks.empty() ? 1 : tracks.front().number));
+    PushResponse(ToBCD(tracks.empty() ? 1 : tracks.back().number));
+}
 
+void cdrom::GetTD() {
+    // Track 0 is the lead-out
+    uint8_t track_number = FromBCD(GetParam());
+    uint32_t lba = game_disk.GetLeadOut();
+    bool found = track_number == 0;
+    for (const Disk::Track& track : game_disk.GetTracks()) {
+        if (track.number == track_number) {
+            lba = track.start_lba;
+            found = true;
+        }
+    }
+    if (!found) {
+        irq_fifo.Push(0x5);
+        PushResponse(status_code.reg | 0x1);
+        PushResponse(0x10);     // invalid parameter
+        return;
+    }
+    irq_fifo.Push(0x3);
+    PushResponse(status_code.reg);
+    PushResponse(ToBCD(lba / (60 * 75)));
+    PushResponse(ToBCD(lba / 75 % 60));
 }
 
 uint8_t cdrom::GetParam() {
-    uint8_t param = param_fifo.front();
-    param_fifo.pop_front();
-    status.param_fifo_empty = param_fifo.empty();
+    if (param_fifo.Empty()) {
+        return 0;
+    }
+    uint8_t param = param_fifo.Front();
+    param_fifo.Pop();
+    status.param_fifo_empty = param_fifo.Empty();
     status.param_fifo_full = 1;
     return param;
 }
 
 void cdrom::PushResponse(uint8_t response) {
-    response_fifo.push_back(response);
+    response_fifo.Push(response);
     status.response_fifo_empty = 1;
 }
 
@@ -261,41 +407,50 @@ uint32_t cdrom::GetLBA(uint8_t mm, uint8_t ss, uint8_t sect) const {
     return (mm * 60 * 75) + (ss * 75) + sect;
 }
 
-uint8_t cdrom::GetByte() {
-    if (data_buffer.empty()) {
-        return 0;
-    }
-    int data_start = 12;
-    if (!mode.sector_size) {
-        data_start += 12;
-    }
-    
-    if (!mode.sector_size && data_buffer_index >= 0x800) {
-        data_buffer_index++;
-        return data_buffer[data_start + 0x800 - 8];
-    } else if (mode.sector_size && data_buffer_index >= 0x924) {
-        data_buffer_index++;
-        return data_buffer[data_start + 0x924 - 4];
+// Points the data FIFO at the latest sector, skipping the sync (and header in 0x800 mode)
+void cdrom::LoadDataSector() {
+    if (read_data.size() < Disk::kSectorSize) {
+        data_sector = nullptr;
+        data_index = data_end = 0;
+        return;
     }
-
-    uint8_t data = data_buffer[data_start + data_buffer_index++];   // skip the sync
-
-    if (IsBufferEmpty()) {
-        status.data_fifo_empty = 0;
+    data_sector = read_data.data();
+    if (mode.sector_size) {
+        data_index = 12;
+        data_end = 12 + 0x924;
+        data_overrun = data_end - 4;
+    } else {
+        data_index = 24;
+        data_end = 24 + 0x800;
+        data_overrun = data_end - 8;
     }
-    return data;
+    status.data_fifo_empty = 1;
 }
 
 uint32_t cdrom::GetWord() {
-    uint32_t word = 0;
-    word |= GetByte() << 0;
-    word |= GetByte() << 8;
-    word |= GetByte() << 16;
-    word |= GetByte() << 24;
+    uint32_t word;
+    ReadWords(std::span<uint32_t>(&word, 1));
     return word;
 }
 
+void cdrom::ReadWords(std::span<uint32_t> dest) {
+    uint8_t* bytes = (uint8_t*)dest.data();
+    uint32_t size = (uint32_t)dest.size_bytes();
+    uint32_t copied = 0;
+    if (data_index < data_end) {
+        copied = std::min(size, data_end - data_index);
+        memcpy(bytes, data_sector + data_index, copied);
+        data_index += copied;
+        if (IsBufferEmpty()) {
+            status.data_fifo_empty = 0;
+        }
+    }
+    // Reads past the end of the sector repeat the same byte
+    if (copied < size) {
+        memset(bytes + copied, data_sector != nullptr ? data_sector[data_overrun] : 0, size - copied);
+    }
+}
+
 bool cdrom::IsBufferEmpty() const {
-    return data_buffer.empty() || (!mode.sector_size && data_buffer_index >= 0x800) 
-        || (mode.sector_size && data_buffer_index >= 0x924);
-}
\ No newline at end of file
+    return data_index >= data_end;
+}
@@ -1,41 +1,67 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
-#include <deque>
+#include <span>
+#include <string>
+#include <vector>
 #include "IRQ.h"
 #include "Disk.h"
+#include "CDAudio.h"
+#include "ReadAhead.h"
+#include "FIFO.h"
 
 class cdrom {
 public:
-    void Cycle();
-    void Init(IRQ* irq);
+    // Advances the drive by CPU cycles, sectors come in at 75 per second (150 at double speed)
+    void Cycle(uint32_t cycles);
+    void Init(IRQ* irq, CDAudio* cd_audio);
+    // .cue sheet, raw BIN or compressed .cdz image
+    void LoadDisc(const std::string& path);
+    // The executable named by BOOT in SYSTEM.CNF, or PSX.EXE without one
+    bool ReadBootExe(std::vector<uint8_t>& exe);
 
     void Write8(uint32_t offset, uint8_t data);
     uint8_t Read8(uint32_t offset);
     uint32_t GetWord();
+    void ReadWords(std::span<uint32_t> dest);
 private:
     IRQ* irq;
+    CDAudio* cd_audio;
     Disk game_disk;
+    ReadAhead read_ahead;       // declared after game_disk, stops reading before it goes away
 
-    std::vector<uint8_t> read_data{};
-    std::vector<uint8_t> data_buffer{};
-    uint32_t data_buffer_index = 0;
-    uint8_t GetByte();
+    // Two sector buffer, the host reads the sector it requested in place while the
+    // next one comes in
+    std::array<std::array<uint8_t, Disk::kSectorSize>, 2> sectors{};
+    uint32_t latest_sector = 0;
+    std::span<const uint8_t> read_data{};   // latest sector, empty past the lead-out
+    // Data FIFO, offsets into data_sector latched from the mode when it was requested
+    const uint8_t* data_sector = nullptr;
+    uint32_t data_index = 0;
+    uint32_t data_end = 0;
+    uint32_t data_overrun = 0;              // byte repeated by reads past the end
+    void LoadDataSector();
     bool IsBufferEmpty() const;
     
     void ExecuteCommand(uint8_t opcode);
     void SetLoc();
+    void Play();
     void ReadN();
     void Pause();
     void InitCommand();
     void Mute();
     void Demute();
+    void SetFilter();
     void SetMode();
     void GetTN();
+    void GetTD();
     void SeekL();
     void TestCommand(uint8_t command);
     uint8_t GetParam();
     void PushResponse(uint8_t response);
+    bool RouteAudioSector();
+    int32_t GetCyclesPerSector() const;
 
     uint32_t GetLBA(uint8_t mm, uint8_t ss, uint8_t sect) const;
 
@@ -85,13 +111,18 @@ private:
     uint8_t vol_left_right = 0;
     uint8_t vol_right_right = 0;
     uint8_t vol_right_left = 0;
+    bool muted = false;         // Mute/Demute, both XA and CD-DA
+    bool adpcm_muted = false;   // 1F801803h.Index3 bit 0, XA only
+    uint8_t filter_file = 0;
+    uint8_t filter_channel = 0;
 
-    std::deque<uint8_t> param_fifo = {};
-    std::deque<uint8_t> response_fifo = {};
-    std::deque<uint8_t> irq_fifo = {};
+    FIFO<uint8_t, 16> param_fifo;
+    FIFO<uint8_t, 16> response_fifo;
+    FIFO<uint8_t, 8> irq_fifo;
 
     uint8_t mm, ss, sect;
     uint32_t read_sector, seek_sector;
-    uint32_t steps_until_read = 1150;
+    static constexpr int32_t kCyclesPerSector = 451584;     // 33.8688MHz / 75
+    int32_t cycles_until_read = kCyclesPerSector;
 };
 
@@ -4,12 +4,15 @@
 #include <string>
 #include <vector>
 
-#include "PSX.h"
+#include "EmuThread.h"
 #include "Constants.h"
 #include "Shader.h"
 
 void FramebufferSizeCallback(GLFWwindow* window, int width, int height);
-void ProcessInput(GLFWwindow* window);
+void ProcessInput(GLFWwindow* window, EmuThread& emu);
+bool WasKeyPressed(GLFWwindow* window, int key, bool& key_down);
+
+const char* kDefaultDiscPath = "games/castlevania_1.BIN";
 
 int main(int argc, char** argv) {
     glfwInit();
@@ -35,10 +38,10 @@ int main(int argc, char** argv) {
 
     glfwMakeContextCurrent(window);
     glViewport(0, 0, VRAM_WIDTH, VRAM_HEIGHT);
+    glfwSwapInterval(1);
     Shader shader("VertexShader.glsl", "FragmentShader.glsl");
-    PSX system;
+    EmuThread emu;
 
-    const uint16_t* data = system.GetVRAM().data();
     // create and bind texture
     GLuint texture;
     glGenTextures(1, &texture);
@@ -48,7 +51,7 @@ int main(int argc, char** argv) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1024, 512, 0, GL_RGBA, GL_UNSIGNED_SHORT_1_5_5_5_REV, (const void*)data);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1024, 512, 0, GL_RGBA, GL_UNSIGNED_SHORT_1_5_5_5_REV, nullptr);
     glGenerateMipmap(GL_TEXTURE_2D);
 
     float vertices[] = {
@@ -91,36 +94,82 @@ int main(int argc, char** argv) {
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
-    int cycles = 1;
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
+    // usage: PSXEmulator [-fastboot] [disc.cue|disc.bin|disc.cdz]
+    bool fast_boot = false;
+    std::string disc_path = kDefaultDiscPath;
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "-fastboot") {
+            fast_boot = true;
+        } else {
+            disc_path = argv[i];
+        }
+    }
+    emu.LoadDisc(disc_path);
+    if (fast_boot && !emu.EnableFastBoot()) {
+        std::cout << "Fast boot unavailable, booting through the BIOS" << std::endl;
+    }
+    emu.Start();
+    // The emulator runs on its own thread, this loop only presents the newest frame
     while (!glfwWindowShouldClose(window)) {
-        ProcessInput(window);
-        system.RunFrame();
-        //system.DumpRAM();
-        glfwSwapBuffers(window);
-        data = system.GetVRAM().data();
+        ProcessInput(window, emu);
         glBindVertexArray(VAO);
         shader.Use();
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, texture);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, VRAM_WIDTH, VRAM_HEIGHT, GL_RGBA,
-            GL_UNSIGNED_SHORT_1_5_5_5_REV, (const void*)data);
+        if (const GPU::VRAM* frame = emu.GetLatestFrame()) {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, VRAM_WIDTH, VRAM_HEIGHT, GL_RGBA,
+                GL_UNSIGNED_SHORT_1_5_5_5_REV, (const void*)frame->data());
+        }
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-        
-        cycles++;
-        
+        glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
+    emu.Stop();
     glfwTerminate();
     return 0;
 }
 
-void ProcessInput(GLFWwindow* window) {
+void ProcessInput(GLFWwindow* window, EmuThread& emu) {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
         glfwSetWindowShouldClose(window, true);
     }
+    // F1 toggles automatic frame skipping, F2 toggles field rendering in 480i modes,
+    // F3 starts/stops recording the GPU command stream, F4 starts/stops recording audio
+    static bool frame_skip_key_down = false;
+    static bool field_rendering_key_down = false;
+    static bool gpu_recording_key_down = false;
+    static bool audio_recording_key_down = false;
+    if (WasKeyPressed(window, GLFW_KEY_F1, frame_skip_key_down)) {
+        emu.SetAutoFrameSkip(!emu.GetAutoFrameSkip());
+    }
+    if (WasKeyPressed(window, GLFW_KEY_F2, field_rendering_key_down)) {
+        emu.SetFieldRendering(!emu.GetFieldRendering());
+    }
+    if (WasKeyPressed(window, GLFW_KEY_F3, gpu_recording_key_down)) {
+        emu.SetGPURecording(!emu.GetGPURecording());
+    }
+    if (WasKeyPressed(window, GLFW_KEY_F4, audio_recording_key_down)) {
+        emu.SetAudioRecording(!emu.GetAudioRecording());
+    }
+
+    // Hold Tab to fast-forward, hold ` for slow motion
+    if (glfwGetKey(window, GLFW_KEY_TAB) == GLFW_PRESS) {
+        emu.SetPacing(EmuThread::Pacing::FastForward);
+    } else if (glfwGetKey(window, GLFW_KEY_GRAVE_ACCENT) == GLFW_PRESS) {
+        emu.SetPacing(EmuThread::Pacing::SlowMotion);
+    } else {
+        emu.SetPacing(EmuThread::Pacing::Locked);
+    }
+}
+
+bool WasKeyPressed(GLFWwindow* window, int key, bool& key_down) {
+    bool pressed = glfwGetKey(window, key) == GLFW_PRESS;
+    bool was_pressed = pressed && !key_down;
+    key_down = pressed;
+    return was_pressed;
 }
 
 void FramebufferSizeCallback(GLFWwindow* window, int width, int height) {
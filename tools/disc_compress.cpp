@@ -0,0 +1,127 @@
+// Converts raw disc images to the compressed .cdz format and checks the result.
+// For a .cue sheet every FILE is compressed next to the output sheet, which then
+// references the .cdz files instead.
+//
+// usage: disc_compress <in.bin> <out.cdz>
+//        disc_compress <in.cue> <out.cue>
+//        disc_compress -verify <in.bin> <in.cdz>     compare every sector, time sequential reads
+
+#include "../CompressedImage.h"
+#include "../MappedFile.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+// Double speed data rate, 150 sectors per second
+const double kDoubleSpeedBytesPerSecond = 150.0 * CompressedImage::kSectorSize;
+
+bool HasExtension(const std::string& path, const char* extension) {
+    std::string actual = std::filesystem::path(path).extension().string();
+    for (char& c : actual) {
+        c = (char)tolower(c);
+    }
+    return actual == extension;
+}
+
+bool CompressFile(const std::string& in_path, const std::string& out_path) {
+    MappedFile in;
+    if (!in.Open(in_path)) {
+        return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+    if (!CompressedImage::Create(in.GetData(), in.GetSize(), out_path)) {
+        printf("Could not write %s\n", out_path.c_str());
+        return false;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uintmax_t out_size = std::filesystem::file_size(out_path);
+    printf("%s: %zu -> %llu bytes (%.1f%%) in %.2fs\n", in_path.c_str(), in.GetSize(),
+        (unsigned long long)out_size, in.GetSize() ? 100.0 * out_size / in.GetSize() : 0.0, seconds);
+    return true;
+}
+
+// Rewrites every FILE line to point at the compressed copy
+int CompressCue(const std::string& in_path, const std::string& out_path) {
+    std::ifstream in(in_path);
+    if (!in.is_open()) {
+        printf("Could not open %s\n", in_path.c_str());
+        return 1;
+    }
+    std::filesystem::path in_directory = std::filesystem::path(in_path).parent_path();
+    std::filesystem::path out_directory = std::filesystem::path(out_path).parent_path();
+    std::ostringstream cue;
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t first_quote = line.find('"');
+        size_t last_quote = line.rfind('"');
+        if (line.find("FILE") == std::string::npos || first_quote == last_quote) {
+            cue << line << "\n";
+            continue;
+        }
+        std::string name = line.substr(first_quote + 1, last_quote - first_quote - 1);
+        std::string compressed_name = std::filesystem::path(name).stem().string() + ".cdz";
+        if (!CompressFile((in_directory / name).string(), (out_directory / compressed_name).string())) {
+            return 1;
+        }
+        cue << line.substr(0, first_quote + 1) << compressed_name << line.substr(last_quote) << "\n";
+    }
+    std::ofstream out(out_path);
+    out << cue.str();
+    return out.good() ? 0 : 1;
+}
+
+int Verify(const std::string& raw_path, const std::string& compressed_path) {
+    MappedFile raw;
+    CompressedImage image;
+    if (!raw.Open(raw_path) || !image.Open(compressed_path)) {
+        return 1;
+    }
+    uint32_t sectors = image.GetSectorCount();
+    if (sectors != raw.GetSize() / CompressedImage::kSectorSize) {
+        printf("Sector count mismatch: %u, expected %zu\n", sectors, raw.GetSize() / CompressedImage::kSectorSize);
+        return 1;
+    }
+
+    // Sequential, like ReadN streaming a file
+    uint32_t failures = 0;
+    double seconds = 0.0;
+    for (uint32_t sector = 0; sector < sectors; sector++) {
+        auto start = std::chrono::steady_clock::now();
+        const uint8_t* data = image.ReadSector(sector);
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const uint8_t* expected = raw.GetData() + (size_t)sector * CompressedImage::kSectorSize;
+        if (data == nullptr || memcmp(data, expected, CompressedImage::kSectorSize) != 0) {
+            if (failures++ < 20) {
+                printf("sector %u differs\n", sector);
+            }
+        }
+    }
+    double bytes_per_second = seconds > 0.0 ? sectors * (double)CompressedImage::kSectorSize / seconds : 0.0;
+    printf("%u sectors, %u mismatching\n", sectors, failures);
+    printf("sequential reads: %.1f MB/s, %.0fx the double speed data rate\n", bytes_per_second / 1000000.0,
+        bytes_per_second / kDoubleSpeedBytesPerSecond);
+    printf("hunk cache: %llu hits, %llu misses\n", (unsigned long long)image.GetCacheStats().hits,
+        (unsigned long long)image.GetCacheStats().misses);
+    return failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+    if (argc == 4 && strcmp(argv[1], "-verify") == 0) {
+        return Verify(argv[2], argv[3]);
+    }
+    if (argc == 3 && HasExtension(argv[1], ".cue")) {
+        return CompressCue(argv[1], argv[2]);
+    }
+    if (argc == 3) {
+        return CompressFile(argv[1], argv[2]) ? 0 : 1;
+    }
+    printf("usage: %s <in.bin> <out.cdz>\n", argv[0]);
+    printf("       %s <in.cue> <out.cue>\n", argv[0]);
+    printf("       %s -verify <in.bin> <in.cdz>\n", argv[0]);
+    return 1;
+}
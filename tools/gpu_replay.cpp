@@ -0,0 +1,124 @@
+// Replays a GPU command stream dump (see GPUDump.h) without the rest of the
+// emulator and reports per-frame rasterization time and a hash of the final VRAM.
+//
+// usage: gpu_replay <dump file> [-loops N] [-png]
+
+#include "../GPU.h"
+#include "../GPUDump.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+struct ReplayFrame {
+    std::vector<GPUDumpRecord> records;
+};
+
+uint64_t HashVRAM(const GPU::VRAM& vram) {
+    // FNV-1a 64
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (uint16_t pixel : vram) {
+        hash = (hash ^ (pixel & 0xFF)) * 0x100000001B3ull;
+        hash = (hash ^ (pixel >> 8)) * 0x100000001B3ull;
+    }
+    return hash;
+}
+
+double RunFrames(GPU& gpu, const std::vector<ReplayFrame>& frames, std::vector<double>& frame_ms) {
+    using clock = std::chrono::steady_clock;
+    double total_ms = 0.0;
+    for (size_t i = 0; i < frames.size(); i++) {
+        auto start = clock::now();
+        for (const GPUDumpRecord& record : frames[i].records) {
+            uint32_t offset = record.type == GPUDumpRecord::Type::GP0 ? 0 : 4;
+            for (uint32_t word : record.words) {
+                gpu.Write32(offset, word);
+            }
+        }
+        double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+        frame_ms[i] = std::min(frame_ms[i], ms);
+        total_ms += ms;
+    }
+    return total_ms;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        printf("usage: %s <dump file> [-loops N] [-png]\n", argv[0]);
+        return 1;
+    }
+    int loops = 1;
+    bool write_png = false;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-loops") == 0 && i + 1 < argc) {
+            loops = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "-png") == 0) {
+            write_png = true;
+        } else {
+            printf("Unknown argument %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    // Load the whole dump up front so file IO doesn't show up in the timings
+    auto initial_vram = std::make_unique<GPU::VRAM>();
+    GPUDumpReader reader;
+    if (!reader.Open(argv[1], initial_vram->data(), initial_vram->size())) {
+        printf("Could not open GPU dump %s\n", argv[1]);
+        return 1;
+    }
+    std::vector<ReplayFrame> frames(1);
+    GPUDumpRecord record;
+    size_t words = 0;
+    while (reader.ReadRecord(record)) {
+        if (record.type == GPUDumpRecord::Type::Frame) {
+            frames.emplace_back();
+        } else {
+            words += record.words.size();
+            frames.back().records.push_back(record);
+        }
+    }
+    if (frames.back().records.empty()) {
+        frames.pop_back();
+    }
+    printf("%zu frames, %zu command words\n", frames.size(), words);
+
+    // Keep the fastest run of every frame to filter out scheduling noise
+    std::vector<double> frame_ms(frames.size(), 1e30);
+    uint64_t hash = 0;
+    double best_total_ms = 1e30;
+    auto gpu = std::make_unique<GPU>();
+    for (int loop = 0; loop < loops; loop++) {
+        gpu = std::make_unique<GPU>();
+        gpu->Init(nullptr);
+        gpu->GetVRAM() = *initial_vram;
+        best_total_ms = std::min(best_total_ms, RunFrames(*gpu, frames, frame_ms));
+        uint64_t loop_hash = HashVRAM(gpu->GetVRAM());
+        if (loop > 0 && loop_hash != hash) {
+            printf("VRAM hash mismatch between loops (%016llx != %016llx)\n",
+                (unsigned long long)loop_hash, (unsigned long long)hash);
+            return 1;
+        }
+        hash = loop_hash;
+    }
+
+    for (size_t i = 0; i < frames.size(); i++) {
+        printf("frame %4zu: %8.3f ms\n", i, frame_ms[i]);
+    }
+    if (!frames.empty()) {
+        std::vector<double> sorted = frame_ms;
+        std::sort(sorted.begin(), sorted.end());
+        printf("total %.3f ms, avg %.3f ms, median %.3f ms, max %.3f ms\n", best_total_ms,
+            best_total_ms / frames.size(), sorted[sorted.size() / 2], sorted.back());
+    }
+    printf("VRAM hash: %016llx\n", (unsigned long long)hash);
+    if (write_png) {
+        gpu->DumpVRAM();
+    }
+    return 0;
+}
@@ -0,0 +1,273 @@
+// GTE microbenchmark and golden-vector harness. Drives GTE::Write/ExecuteGTECommand/Read
+// only, so any change to the GTE internals can be checked against a recorded run.
+//
+// usage: gte_bench -record <file> [-count N] [-seed N]   generate golden vectors
+//        gte_bench -verify <file>                        compare against golden vectors
+//        gte_bench -bench [-ms N] [-filter name]         ns per command for each opcode
+//
+// gte_golden.gtev next to this file holds 100 vectors per opcode (seed 1) recorded once the
+// UNR table and RTPS divide were exact. Run "gte_bench -verify tools/gte_golden.gtev" from
+// the repository root after any GTE change, it checks eager and lazy FLAG evaluation.
+
+#include "../GTE.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+struct Opcode {
+    const char* name;
+    uint8_t cmd_num;
+};
+
+const Opcode kOpcodes[] = {
+    {"RTPS", 0x01}, {"NCLIP", 0x06}, {"OP", 0x0C}, {"DPCS", 0x10}, {"INTPL", 0x11},
+    {"MVMVA", 0x12}, {"NCDS", 0x13}, {"CDP", 0x14}, {"NCDT", 0x16}, {"NCCS", 0x1B},
+    {"CC", 0x1C}, {"NCS", 0x1E}, {"NCT", 0x20}, {"SQR", 0x28}, {"DCPL", 0x29},
+    {"DPCT", 0x2A}, {"AVSZ3", 0x2D}, {"AVSZ4", 0x2E}, {"RTPT", 0x30}, {"GPF", 0x3D},
+    {"GPL", 0x3E}, {"NCCT", 0x3F}
+};
+const int kOpcodeCount = sizeof(kOpcodes) / sizeof(kOpcodes[0]);
+
+const uint32_t kMagic = 0x56455447;     // "GTEV"
+const uint32_t kVersion = 1;
+
+// Register state before a command, the command and every register read back afterwards
+struct GoldenVector {
+    uint32_t inputs[64];
+    uint32_t inst;
+    uint32_t outputs[64];
+};
+
+// SXY2 pushes the FIFO, ORGB and LZCR are read only and FLAG is what we're checking
+bool IsWritableInput(int reg) {
+    return reg != 15 && reg != 29 && reg != 31 && reg != 63;
+}
+
+void LoadInputs(GTE& gte, const uint32_t inputs[64]) {
+    for (int reg = 0; reg < 64; reg++) {
+        if (IsWritableInput(reg)) {
+            gte.Write(reg, inputs[reg]);
+        }
+    }
+}
+
+void ReadOutputs(GTE& gte, uint32_t outputs[64]) {
+    for (int reg = 0; reg < 64; reg++) {
+        outputs[reg] = gte.Read(reg);
+    }
+}
+
+// Mix of full range values, which mostly saturate, and small ones that stay in range
+void GenerateInputs(std::mt19937& rng, uint32_t inputs[64]) {
+    for (int reg = 0; reg < 64; reg++) {
+        uint32_t value = rng();
+        switch (rng() % 4) {
+            case 0:
+                break;
+            case 1:
+                value &= 0x00FF00FF;
+                break;
+            default: {
+                // Both halfwords sign extended from 12 bits
+                uint16_t low = (uint16_t)((int16_t)(value << 4) >> 4);
+                uint16_t high = (uint16_t)((int16_t)((value >> 16) << 4) >> 4);
+                value = ((uint32_t)high << 16) | low;
+                break;
+            }
+        }
+        inputs[reg] = IsWritableInput(reg) ? value : 0;
+    }
+}
+
+uint32_t GenerateInstruction(std::mt19937& rng, uint8_t cmd_num) {
+    // Random sf, lm and MVMVA operand selection
+    const uint32_t kFieldMask = (1 << 19) | (3 << 17) | (3 << 15) | (3 << 13) | (1 << 10);
+    return 0x4A000000 | cmd_num | (rng() & kFieldMask);
+}
+
+const char* GetOpcodeName(uint32_t inst) {
+    for (const Opcode& opcode : kOpcodes) {
+        if (opcode.cmd_num == (inst & 0x3F)) {
+            return opcode.name;
+        }
+    }
+    return "?";
+}
+
+int Record(const char* path, int count, uint32_t seed) {
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr) {
+        printf("Could not open %s\n", path);
+        return 1;
+    }
+    std::mt19937 rng(seed);
+    uint32_t header[3] = {kMagic, kVersion, (uint32_t)count};
+    fwrite(header, sizeof(header), 1, file);
+    GTE gte;
+    for (int i = 0; i < count; i++) {
+        GoldenVector vector;
+        GenerateInputs(rng, vector.inputs);
+        vector.inst = GenerateInstruction(rng, kOpcodes[i % kOpcodeCount].cmd_num);
+        LoadInputs(gte, vector.inputs);
+        gte.ExecuteGTECommand(vector.inst);
+        ReadOutputs(gte, vector.outputs);
+        fwrite(&vector, sizeof(vector), 1, file);
+    }
+    fclose(file);
+    printf("Recorded %d vectors to %s\n", count, path);
+    return 0;
+}
+
+bool LoadGoldenVectors(const char* path, std::vector<GoldenVector>& vectors) {
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    uint32_t header[3];
+    bool ok = fread(header, sizeof(header), 1, file) == 1 && header[0] == kMagic
+        && header[1] == kVersion;
+    if (ok) {
+        vectors.resize(header[2]);
+        ok = fread(vectors.data(), sizeof(GoldenVector), vectors.size(), file) == vectors.size();
+    }
+    fclose(file);
+    return ok;
+}
+
+int Verify(const char* path) {
+    std::vector<GoldenVector> vectors;
+    if (!LoadGoldenVectors(path, vectors)) {
+        printf("Could not load golden vectors from %s\n", path);
+        return 1;
+    }
+    int failures = 0;
+    for (bool lazy_flags : {true, false}) {
+        GTE gte;
+        gte.SetLazyFlags(lazy_flags);
+        for (size_t i = 0; i < vectors.size(); i++) {
+            const GoldenVector& vector = vectors[i];
+            uint32_t outputs[64];
+            LoadInputs(gte, vector.inputs);
+            gte.ExecuteGTECommand(vector.inst);
+            ReadOutputs(gte, outputs);
+            for (int reg = 0; reg < 64; reg++) {
+                if (outputs[reg] == vector.outputs[reg]) {
+                    continue;
+                }
+                // Only print the first few, a broken command usually fails everywhere
+                if (failures++ < 20) {
+                    printf("vector %zu %s (%08x, %s flags): r%d = %08x, expected %08x\n", i,
+                        GetOpcodeName(vector.inst), vector.inst, lazy_flags ? "lazy" : "eager", reg,
+                        outputs[reg], vector.outputs[reg]);
+                }
+            }
+        }
+    }
+    printf("%zu vectors, %d mismatching registers\n", vectors.size(), failures);
+    return failures == 0 ? 0 : 1;
+}
+
+// Average ns per command, the register writes between bursts aren't timed
+double BenchOpcode(uint8_t cmd_num, bool lazy_flags, double min_ms) {
+    using clock = std::chrono::steady_clock;
+    const int kStates = 256;
+    const int kBurst = 64;
+    std::mt19937 rng(cmd_num);
+    std::vector<GoldenVector> states(kStates);
+    for (GoldenVector& state : states) {
+        GenerateInputs(rng, state.inputs);
+        state.inst = GenerateInstruction(rng, cmd_num);
+    }
+
+    GTE gte;
+    gte.SetLazyFlags(lazy_flags);
+    uint64_t commands = 0;
+    double ns = 0.0;
+    uint32_t sink = 0;
+    while (ns < min_ms * 1000000.0) {
+        for (const GoldenVector& state : states) {
+            LoadInputs(gte, state.inputs);
+            auto start = clock::now();
+            for (int i = 0; i < kBurst; i++) {
+                gte.ExecuteGTECommand(state.inst);
+            }
+            ns += std::chrono::duration<double, std::nano>(clock::now() - start).count();
+            sink += gte.Read(25);
+        }
+        commands += kStates * kBurst;
+    }
+    // Keep the results alive
+    if (sink == 0x12345678) {
+        printf(" ");
+    }
+    return ns / commands;
+}
+
+int Bench(double min_ms, const std::string& filter) {
+    printf("%-8s %12s %12s\n", "opcode", "eager", "lazy flags");
+    for (const Opcode& opcode : kOpcodes) {
+        if (!filter.empty() && filter != opcode.name) {
+            continue;
+        }
+        printf("%-8s", opcode.name);
+        for (bool lazy_flags : {false, true}) {
+            printf(" %12.2f", BenchOpcode(opcode.cmd_num, lazy_flags, min_ms));
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+    printf("ns per command\n");
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    enum class Mode { None, Record, Verify, Bench } mode = Mode::None;
+    const char* path = nullptr;
+    int count = 100000;
+    uint32_t seed = 1;
+    double min_ms = 100.0;
+    std::string filter;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-record") == 0 && i + 1 < argc) {
+            mode = Mode::Record;
+            path = argv[++i];
+        } else if (strcmp(argv[i], "-verify") == 0 && i + 1 < argc) {
+            mode = Mode::Verify;
+            path = argv[++i];
+        } else if (strcmp(argv[i], "-bench") == 0) {
+            mode = Mode::Bench;
+        } else if (strcmp(argv[i], "-count") == 0 && i + 1 < argc) {
+            count = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc) {
+            seed = strtoul(argv[++i], nullptr, 0);
+        } else if (strcmp(argv[i], "-ms") == 0 && i + 1 < argc) {
+            min_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else {
+            mode = Mode::None;
+            break;
+        }
+    }
+
+    switch (mode) {
+        case Mode::Record:
+            return Record(path, count, seed);
+        case Mode::Verify:
+            return Verify(path);
+        case Mode::Bench:
+            return Bench(min_ms, filter);
+        default:
+            printf("usage: %s -record <file> [-count N] [-seed N]\n", argv[0]);
+            printf("       %s -verify <file>\n", argv[0]);
+            printf("       %s -bench [-ms N] [-filter name]\n", argv[0]);
+            return 1;
+    }
+}
@@ -0,0 +1,47 @@
+// Checks GTE::Divide, the UNR divide used by RTPS/RTPT, against the documented
+// algorithm for every (H, SZ3) pair.
+//
+// usage: gte_divide_check
+
+#include "../GTE.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+
+// Straightforward transcription of the documented algorithm, independent of GTE::Divide
+uint32_t ReferenceDivide(uint32_t h, uint32_t sz3) {
+    if (h >= sz3 * 2) {
+        return 0x1FFFF;
+    }
+    int z = 0;
+    while (((sz3 << z) & 0x8000) == 0) {
+        z++;
+    }
+    uint64_t n = (uint64_t)h << z;
+    uint64_t d = (uint64_t)sz3 << z;
+    int index = (int)((d - 0x7FC0) >> 7);
+    uint64_t u = std::max(0, (0x40000 / (index + 0x100) + 1) / 2 - 0x101) + 0x101;
+    d = (0x2000080 - d * u) >> 8;
+    d = (0x0000080 + d * u) >> 8;
+    return (uint32_t)std::min<uint64_t>(0x1FFFF, (n * d + 0x8000) >> 16);
+}
+
+int CheckDivide() {
+    uint64_t failures = 0;
+    for (uint32_t sz3 = 0; sz3 <= 0xFFFF; sz3++) {
+        for (uint32_t h = 0; h <= 0xFFFF; h++) {
+            uint32_t expected = ReferenceDivide(h, sz3);
+            uint32_t result = GTE::Divide(h, sz3);
+            if (result != expected && failures++ < 20) {
+                printf("H=%04x SZ3=%04x: %05x, expected %05x\n", h, sz3, result, expected);
+            }
+        }
+    }
+    printf("%llu mismatching divides\n", (unsigned long long)failures);
+    return failures == 0 ? 0 : 1;
+}
+
+int main() {
+    return CheckDivide();
+}
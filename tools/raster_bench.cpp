@@ -0,0 +1,266 @@
+// Synthetic rasterizer benchmark. Builds GP0 packets for every primitive class
+// and feeds them straight into Renderer::DrawPolygon/DrawRect, reporting the
+// fill rate of each class in Mpixels/s.
+//
+// usage: raster_bench [-filter name] [-ms N] [-overdraw N]
+
+#include "../GPU.h"
+#include "../Renderer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Primitives are drawn on a grid inside this area, textures and CLUTs live outside of it
+const int kTargetWidth = 512;
+const int kTargetHeight = 256;
+const uint32_t kTexPageX = 8;       // texpage at (512, 0)
+const uint32_t kClutX = 0;
+const uint32_t kClutY = 480;
+const uint32_t kClut = (kClutX / 16) | (kClutY << 6);
+
+enum class PrimitiveKind {
+    Polygon,
+    Rect
+};
+
+struct PrimitiveClass {
+    std::string name;
+    PrimitiveKind kind;
+    uint8_t opcode;
+    TextureDepth depth;
+    uint32_t semi_mode;
+};
+
+struct BenchResult {
+    double mpixels_per_sec;
+    uint64_t pixels;
+    double ms;
+};
+
+uint32_t PackVertex(int x, int y) {
+    return ((uint32_t)(y & 0x7FF) << 16) | (x & 0x7FF);
+}
+
+uint32_t PackTexcoord(int u, int v, uint16_t extra) {
+    u = std::min(u, 255);
+    v = std::min(v, 255);
+    return ((uint32_t)extra << 16) | (v << 8) | u;
+}
+
+uint32_t GetTexPage(const PrimitiveClass& prim) {
+    return kTexPageX | (prim.semi_mode << 5) | ((uint32_t)prim.depth << 7);
+}
+
+// Quads of size x size pixels, split into two triangles by the renderer
+std::vector<uint32_t> BuildPolygon(const PrimitiveClass& prim, int x, int y, int size) {
+    PolygonArgs args{prim.opcode};
+    const int xs[4] = {x, x + size, x, x + size};
+    const int ys[4] = {y, y, y + size, y + size};
+    const uint32_t colors[4] = {0x808080, 0x2040F0, 0xF04020, 0x40F040};
+    std::vector<uint32_t> commands;
+    for (int i = 0; i < 3 + args.four_point; i++) {
+        if (i == 0) {
+            commands.push_back(((uint32_t)prim.opcode << 24) | colors[0]);
+        } else if (args.shaded) {
+            commands.push_back(colors[i]);
+        }
+        commands.push_back(PackVertex(xs[i], ys[i]));
+        if (args.textured) {
+            uint16_t extra = i == 0 ? kClut : (i == 1 ? GetTexPage(prim) : 0);
+            commands.push_back(PackTexcoord(xs[i] - x, ys[i] - y, extra));
+        }
+    }
+    return commands;
+}
+
+std::vector<uint32_t> BuildRect(const PrimitiveClass& prim, int x, int y, int size) {
+    RectangleArgs args{prim.opcode};
+    std::vector<uint32_t> commands;
+    commands.push_back(((uint32_t)prim.opcode << 24) | 0x808080);
+    commands.push_back(PackVertex(x, y));
+    if (args.textured) {
+        commands.push_back(PackTexcoord(0, 0, kClut));
+    }
+    if (args.size == Size::Variable) {
+        commands.push_back(((uint32_t)size << 16) | size);
+    }
+    return commands;
+}
+
+int GetRectSize(const PrimitiveClass& prim, int size) {
+    RectangleArgs args{prim.opcode};
+    switch (args.size) {
+        case Size::Dot:
+            return 1;
+        case Size::_8x8:
+            return 8;
+        case Size::_16x16:
+            return 16;
+        default:
+            return size;
+    }
+}
+
+std::vector<PrimitiveClass> GetPrimitiveClasses() {
+    const char* depth_names[3] = {"4bpp", "8bpp", "15bpp"};
+    const TextureDepth depths[3] = {TextureDepth::FourBits, TextureDepth::EightBits,
+        TextureDepth::FifteenBits};
+    std::vector<PrimitiveClass> classes;
+    auto add = [&](const std::string& name, PrimitiveKind kind, uint8_t opcode,
+        TextureDepth depth, bool semi_trans) {
+        if (!semi_trans) {
+            classes.push_back({name, kind, opcode, depth, 0});
+            return;
+        }
+        for (uint32_t mode = 0; mode < 4; mode++) {
+            const char* mode_names[4] = {"B/2+F/2", "B+F", "B-F", "B+F/4"};
+            classes.push_back({name + " semi " + mode_names[mode], kind, (uint8_t)(opcode | 0x2),
+                depth, mode});
+        }
+    };
+
+    for (bool semi_trans : {false, true}) {
+        add("poly flat", PrimitiveKind::Polygon, 0x28, TextureDepth::FourBits, semi_trans);
+        add("poly gouraud", PrimitiveKind::Polygon, 0x38, TextureDepth::FourBits, semi_trans);
+        for (int d = 0; d < 3; d++) {
+            std::string depth = depth_names[d];
+            add("poly tex " + depth + " blend", PrimitiveKind::Polygon, 0x2C, depths[d], semi_trans);
+            add("poly tex " + depth + " raw", PrimitiveKind::Polygon, 0x2D, depths[d], semi_trans);
+            add("poly gouraud tex " + depth, PrimitiveKind::Polygon, 0x3C, depths[d], semi_trans);
+        }
+    }
+    const char* size_names[4] = {"variable", "1x1", "8x8", "16x16"};
+    for (bool semi_trans : {false, true}) {
+        for (int size = 0; size < 4; size++) {
+            uint8_t opcode = 0x60 | (size << 3);
+            std::string name = std::string("rect ") + size_names[size];
+            add(name + " flat", PrimitiveKind::Rect, opcode, TextureDepth::FourBits, semi_trans);
+            for (int d = 0; d < 3; d++) {
+                std::string depth = depth_names[d];
+                add(name + " tex " + depth + " blend", PrimitiveKind::Rect, opcode | 0x4, depths[d],
+                    semi_trans);
+                add(name + " tex " + depth + " raw", PrimitiveKind::Rect, opcode | 0x5, depths[d],
+                    semi_trans);
+            }
+        }
+    }
+    return classes;
+}
+
+void SetupVRAM(GPU& gpu) {
+    // Fixed seed so every run rasterizes the same texels
+    uint32_t seed = 0x12345678;
+    auto next = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return seed >> 16;
+    };
+    GPU::VRAM& vram = gpu.GetVRAM();
+    for (int y = 0; y < VRAM_HEIGHT; y++) {
+        for (int x = 0; x < VRAM_WIDTH; x++) {
+            uint16_t pixel = next() & 0x7FFF;
+            // Avoid fully transparent texels and CLUT entries, and set the mask bit on some
+            if (pixel == 0) {
+                pixel = 1;
+            }
+            if ((x & 7) == 0) {
+                pixel |= 0x8000;
+            }
+            vram[y * VRAM_WIDTH + x] = pixel;
+        }
+    }
+    gpu.Write32(0, 0xE3000000);
+    gpu.Write32(0, 0xE4000000 | (VRAM_WIDTH - 1) | ((VRAM_HEIGHT - 1) << 10));
+    gpu.Write32(0, 0xE5000000);
+    gpu.Write32(0, 0xE2000000);
+}
+
+BenchResult RunBenchmark(GPU& gpu, Renderer& renderer, const PrimitiveClass& prim, int size,
+    int overdraw, double min_ms) {
+    using clock = std::chrono::steady_clock;
+    // Rects take their texpage and blending mode from the draw mode, so does an untextured polygon
+    gpu.Write32(0, 0xE1000000 | GetTexPage(prim));
+
+    int prim_size = prim.kind == PrimitiveKind::Rect ? GetRectSize(prim, size) : size;
+    std::vector<std::vector<uint32_t>> packets;
+    for (int y = 0; y + prim_size <= kTargetHeight; y += prim_size) {
+        for (int x = 0; x + prim_size <= kTargetWidth; x += prim_size) {
+            for (int i = 0; i < overdraw; i++) {
+                if (prim.kind == PrimitiveKind::Polygon) {
+                    packets.push_back(BuildPolygon(prim, x, y, prim_size));
+                } else {
+                    packets.push_back(BuildRect(prim, x, y, prim_size));
+                }
+            }
+        }
+    }
+    uint64_t pixels_per_pass = (uint64_t)packets.size() * prim_size * prim_size;
+
+    uint64_t pixels = 0;
+    auto start = clock::now();
+    double ms = 0.0;
+    do {
+        for (const std::vector<uint32_t>& commands : packets) {
+            if (prim.kind == PrimitiveKind::Polygon) {
+                renderer.DrawPolygon(commands);
+            } else {
+                renderer.DrawRect(commands);
+            }
+        }
+        pixels += pixels_per_pass;
+        ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+    } while (ms < min_ms);
+    return {pixels / (ms * 1000.0), pixels, ms};
+}
+
+int main(int argc, char** argv) {
+    std::string filter;
+    double min_ms = 200.0;
+    int overdraw = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "-ms") == 0 && i + 1 < argc) {
+            min_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-overdraw") == 0 && i + 1 < argc) {
+            overdraw = std::max(1, atoi(argv[++i]));
+        } else {
+            printf("usage: %s [-filter name] [-ms N] [-overdraw N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    auto gpu = std::make_unique<GPU>();
+    gpu->Init(nullptr);
+    Renderer renderer(gpu.get());
+    const int sizes[3] = {8, 32, 128};
+
+    printf("%-40s %12s %12s %12s\n", "class", "8px", "32px", "128px");
+    for (const PrimitiveClass& prim : GetPrimitiveClasses()) {
+        if (!filter.empty() && prim.name.find(filter) == std::string::npos) {
+            continue;
+        }
+        RectangleArgs rect_args{prim.opcode};
+        bool fixed_size = prim.kind == PrimitiveKind::Rect && rect_args.size != Size::Variable;
+        printf("%-40s", prim.name.c_str());
+        for (int size : sizes) {
+            if (fixed_size && size != sizes[0]) {
+                printf(" %12s", "-");
+                continue;
+            }
+            SetupVRAM(*gpu);
+            BenchResult result = RunBenchmark(*gpu, renderer, prim, size, overdraw, min_ms);
+            printf(" %12.2f", result.mpixels_per_sec);
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+    printf("Mpixels/s, nominal primitive area\n");
+    return 0;
+}